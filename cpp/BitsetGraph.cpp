@@ -0,0 +1,159 @@
+#include "BitsetGraph.h"
+#include "EulerTourForest.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace dgraph {
+    using std::vector;
+
+    namespace {
+        unsigned lowest(std::uint64_t bits) {
+#if defined(__GNUC__)
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+            unsigned k = 0;
+            while ((bits & 1) == 0) {
+                bits >>= 1;
+                k++;
+            }
+            return k;
+#endif
+        }
+    }
+
+    BitsetGraph::BitsetGraph(unsigned n) :n(0), stride(0), last(0) {
+        resize(n);
+    }
+
+    // the rows of the vertices that stay are laid out again at the new
+    // width, the words past it and the rows of the others are dropped
+    void BitsetGraph::resize(unsigned n) {
+        unsigned words = (n + 63) / 64;
+        if (words != stride || n < this->n) {
+            unsigned common = std::min(stride, words);
+            vector<unsigned> kept(n, NIL);
+            unsigned count = 0;
+            for (unsigned v = 0; v < std::min(this->n, n); v++) {
+                if (rows[v] != NIL) {
+                    kept[v] = count++;
+                }
+            }
+            for (vector<std::uint64_t>* bits : {&adj, &tree}) {
+                vector<std::uint64_t> copy(static_cast<std::size_t>(count) * words, 0);
+                for (unsigned v = 0; v < std::min(this->n, n); v++) {
+                    if (kept[v] != NIL) {
+                        std::copy(bits->begin() + static_cast<std::size_t>(rows[v]) * stride,
+                                  bits->begin() + static_cast<std::size_t>(rows[v]) * stride + common,
+                                  copy.begin() + static_cast<std::size_t>(kept[v]) * words);
+                    }
+                }
+                bits->swap(copy);
+            }
+            rows.swap(kept);
+            stride = words;
+        } else {
+            rows.resize(n, NIL);
+        }
+        seen[0].assign(stride, 0);
+        seen[1].assign(stride, 0);
+        this->n = n;
+    }
+
+    const std::uint64_t* BitsetGraph::row(const vector<std::uint64_t>& bits, unsigned v) const {
+        return rows[v] == NIL ? nullptr : &bits[static_cast<std::size_t>(rows[v]) * stride];
+    }
+
+    // a pair going off has both rows already
+    void BitsetGraph::flip(vector<std::uint64_t>& bits, unsigned v, unsigned u, bool on) {
+        for (unsigned x : {v, u}) {
+            if (rows[x] == NIL) {
+                if (!on) {
+                    return;
+                }
+                rows[x] = static_cast<unsigned>(adj.size() / stride);
+                adj.resize(adj.size() + stride, 0);
+                tree.resize(tree.size() + stride, 0);
+            }
+        }
+        std::uint64_t* cells[2] = {&bits[static_cast<std::size_t>(rows[v]) * stride + u / 64],
+                                   &bits[static_cast<std::size_t>(rows[u]) * stride + v / 64]};
+        std::uint64_t masks[2] = {static_cast<std::uint64_t>(1) << (u % 64),
+                                  static_cast<std::uint64_t>(1) << (v % 64)};
+        for (unsigned k = 0; k < 2; k++) {
+            if (on) {
+                *cells[k] |= masks[k];
+            } else {
+                *cells[k] &= ~masks[k];
+            }
+        }
+    }
+
+    void BitsetGraph::set_edge(unsigned v, unsigned u, bool on) {
+        flip(adj, v, u, on);
+    }
+
+    void BitsetGraph::set_tree_edge(unsigned v, unsigned u, bool on) {
+        flip(tree, v, u, on);
+    }
+
+    void BitsetGraph::neighbours(unsigned v, vector<unsigned>& out) const {
+        const std::uint64_t* row = this->row(adj, v);
+        if (row == nullptr) {
+            return;
+        }
+        for (unsigned w = 0; w < stride; w++) {
+            for (std::uint64_t bits = row[w]; bits != 0; bits &= bits - 1) {
+                out.push_back(64 * w + lowest(bits));
+            }
+        }
+    }
+
+    std::size_t BitsetGraph::words() const {
+        return adj.size() + tree.size();
+    }
+
+    const vector<unsigned>& BitsetGraph::smaller_tree(unsigned v, unsigned u) {
+        unsigned ends[2] = {v, u};
+        unsigned head[2] = {0, 0};
+        for (unsigned side = 0; side < 2; side++) {
+            std::fill(seen[side].begin(), seen[side].end(), 0);
+            seen[side][ends[side] / 64] |= static_cast<std::uint64_t>(1) << (ends[side] % 64);
+            frontier[side].assign(1, ends[side]);
+        }
+        while (true) {
+            for (unsigned side = 0; side < 2; side++) {
+                if (head[side] == frontier[side].size()) {
+                    last = side;
+                    return frontier[side];
+                }
+                unsigned x = frontier[side][head[side]++];
+                const std::uint64_t* row = this->row(tree, x);
+                std::uint64_t* mark = seen[side].data();
+                for (unsigned w = 0; row != nullptr && w < stride; w++) {
+                    std::uint64_t bits = row[w] & ~mark[w];
+                    mark[w] |= bits;
+                    for (; bits != 0; bits &= bits - 1) {
+                        frontier[side].push_back(64 * w + lowest(bits));
+                    }
+                }
+            }
+        }
+    }
+
+    bool BitsetGraph::leaving(unsigned& x, unsigned& y) const {
+        const std::uint64_t* mark = seen[last].data();
+        for (unsigned z : frontier[last]) {
+            const std::uint64_t* row = this->row(adj, z);
+            for (unsigned w = 0; row != nullptr && w < stride; w++) {
+                std::uint64_t bits = row[w] & ~mark[w];
+                if (bits != 0) {
+                    x = z;
+                    y = 64 * w + lowest(bits);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef DGRAPH_BITSETGRAPH_H
+#define DGRAPH_BITSETGRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dgraph {
+    // the vertex pairs joined by an edge and those joined by a spanning
+    // forest edge as two bit matrices, a row of 64 bit words per vertex.
+    // The searches run a word of the row at a time, which the compiler is
+    // free to vectorise, so a graph of a few hundred vertices is a few
+    // words per row and a cut is settled in a handful of cache lines.
+    // A vertex gets its rows with its first edge, so the matrices hold the
+    // vertices that have edges rather than all of them
+    class BitsetGraph {
+        unsigned n;
+        unsigned stride;
+        std::vector<unsigned> rows;
+        std::vector<std::uint64_t> adj;
+        std::vector<std::uint64_t> tree;
+        std::vector<std::uint64_t> seen[2];
+        std::vector<unsigned> frontier[2];
+        unsigned last;
+
+        const std::uint64_t* row(const std::vector<std::uint64_t>& bits, unsigned v) const;
+        void flip(std::vector<std::uint64_t>& bits, unsigned v, unsigned u, bool on);
+    public:
+        explicit BitsetGraph(unsigned n = 0);
+
+        // keeps the bits of the vertices that stay
+        void resize(unsigned n);
+        void set_edge(unsigned v, unsigned u, bool on);
+        void set_tree_edge(unsigned v, unsigned u, bool on);
+        void neighbours(unsigned v, std::vector<unsigned>& out) const;
+        // the words held by the rows given out so far
+        std::size_t words() const;
+        // after the forest edge between v and u went, the vertices of the
+        // smaller of the two trees it held together, found by walking both
+        // in turns until one runs out
+        const std::vector<unsigned>& smaller_tree(unsigned v, unsigned u);
+        // a pair of the graph from the last smaller tree to outside of it
+        bool leaving(unsigned& x, unsigned& y) const;
+    };
+}
+
+#endif //DGRAPH_BITSETGRAPH_H
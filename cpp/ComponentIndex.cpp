@@ -0,0 +1,233 @@
+#include "ComponentIndex.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace dgraph {
+
+    ComponentIndex::ComponentIndex(unsigned n) :count(n), version(0) {
+        grow(n);
+    }
+
+    // an odd version marks a relabelling in progress
+    void ComponentIndex::begin() {
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void ComponentIndex::end() {
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    unsigned ComponentIndex::read_begin() const {
+        unsigned before;
+        while ((before = version.load(std::memory_order_acquire)) & 1) {
+            std::this_thread::yield();
+        }
+        return before;
+    }
+
+    bool ComponentIndex::read_end(unsigned before) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == before;
+    }
+
+    unsigned ComponentIndex::label(unsigned v) const {
+        return labels[v].load(std::memory_order_relaxed);
+    }
+
+    unsigned ComponentIndex::label_size(unsigned label) const {
+        return sizes[label].load(std::memory_order_relaxed);
+    }
+
+    // relabels the smaller of the components of v and u and splices its
+    // list into the other one; false if they were one already
+    bool ComponentIndex::join(unsigned v, unsigned u) {
+        unsigned from = label(v);
+        unsigned into = label(u);
+        if (from == into) {
+            return false;
+        }
+        if (label_size(from) > label_size(into)) {
+            std::swap(from, into);
+        }
+        unsigned first = heads[from];
+        begin();
+        unsigned w = first;
+        do {
+            labels[w].store(into, std::memory_order_relaxed);
+            w = next[w];
+        } while (w != first);
+        sizes[into].store(label_size(into) + label_size(from), std::memory_order_relaxed);
+        sizes[from].store(0, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        end();
+        unsigned head = heads[into];
+        unsigned last = prev[first];
+        unsigned tail = prev[head];
+        next[tail] = first;
+        prev[first] = tail;
+        next[last] = head;
+        prev[head] = last;
+        free_labels.push_back(from);
+        return true;
+    }
+
+    // moved leave from for a fresh label
+    void ComponentIndex::split(unsigned from, const std::vector<unsigned>& moved) {
+        unsigned into = free_labels.back();
+        free_labels.pop_back();
+        begin();
+        for (unsigned v : moved) {
+            labels[v].store(into, std::memory_order_relaxed);
+        }
+        unsigned size = static_cast<unsigned>(moved.size());
+        sizes[into].store(size, std::memory_order_relaxed);
+        sizes[from].store(label_size(from) - size, std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        end();
+        for (unsigned v : moved) {
+            if (heads[from] == v) {
+                heads[from] = next[v];
+            }
+            next[prev[v]] = next[v];
+            prev[next[v]] = prev[v];
+        }
+        for (unsigned k = 0; k < moved.size(); k++) {
+            unsigned v = moved[k];
+            next[v] = moved[(k + 1) % moved.size()];
+            prev[v] = moved[(k + moved.size() - 1) % moved.size()];
+        }
+        heads[into] = moved[0];
+    }
+
+    void ComponentIndex::add_degree(unsigned v, int delta) {
+        degrees[v].store(degrees[v].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    unsigned ComponentIndex::capacity() const {
+        return static_cast<unsigned>(labels.size());
+    }
+
+    void ComponentIndex::grow(unsigned capacity) {
+        unsigned old = this->capacity();
+        std::vector<std::atomic<unsigned>> grown[3] = {std::vector<std::atomic<unsigned>>(capacity),
+                                                       std::vector<std::atomic<unsigned>>(capacity),
+                                                       std::vector<std::atomic<unsigned>>(capacity)};
+        for (unsigned v = 0; v < capacity; v++) {
+            grown[0][v].store(v < old ? label(v) : v, std::memory_order_relaxed);
+            grown[1][v].store(v < old ? label_size(v) : 1, std::memory_order_relaxed);
+            grown[2][v].store(v < old ? degrees[v].load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+        }
+        labels.swap(grown[0]);
+        sizes.swap(grown[1]);
+        degrees.swap(grown[2]);
+        next.resize(capacity);
+        prev.resize(capacity);
+        heads.resize(capacity);
+        for (unsigned v = old; v < capacity; v++) {
+            next[v] = v;
+            prev[v] = v;
+            heads[v] = v;
+        }
+    }
+
+    void ComponentIndex::add_vertices(int delta) {
+        count.store(count.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    namespace {
+        void save_atomics(std::ostream& out, const std::vector<std::atomic<unsigned>>& values) {
+            std::vector<unsigned> plain(values.size());
+            for (unsigned k = 0; k < values.size(); k++) {
+                plain[k] = values[k].load(std::memory_order_relaxed);
+            }
+            snapshot::write_array(out, plain);
+        }
+
+        void load_atomics(std::istream& in, std::vector<std::atomic<unsigned>>& values) {
+            std::vector<unsigned> plain;
+            snapshot::read_array(in, plain);
+            std::vector<std::atomic<unsigned>> loaded(plain.size());
+            for (unsigned k = 0; k < plain.size(); k++) {
+                loaded[k].store(plain[k], std::memory_order_relaxed);
+            }
+            values.swap(loaded);
+        }
+    }
+
+    void ComponentIndex::save(std::ostream& out) const {
+        save_atomics(out, labels);
+        save_atomics(out, sizes);
+        save_atomics(out, degrees);
+        snapshot::write_array(out, free_labels);
+        snapshot::write_array(out, next);
+        snapshot::write_array(out, prev);
+        snapshot::write_array(out, heads);
+        snapshot::write(out, count.load(std::memory_order_relaxed));
+    }
+
+    void ComponentIndex::load(std::istream& in) {
+        load_atomics(in, labels);
+        load_atomics(in, sizes);
+        load_atomics(in, degrees);
+        snapshot::read_array(in, free_labels);
+        snapshot::read_array(in, next);
+        snapshot::read_array(in, prev);
+        snapshot::read_array(in, heads);
+        unsigned components;
+        snapshot::read(in, components);
+        count.store(components, std::memory_order_relaxed);
+    }
+
+    bool ComponentIndex::is_connected(unsigned v, unsigned u) const {
+        while (true) {
+            unsigned before = read_begin();
+            bool same = labels[v].load(std::memory_order_relaxed) == labels[u].load(std::memory_order_relaxed);
+            if (read_end(before)) {
+                return same;
+            }
+        }
+    }
+
+    // answers are validated a chunk at a time, so a long array does not
+    // keep retrying while updates go on
+    void ComponentIndex::is_connected(const std::pair<unsigned, unsigned>* pairs, unsigned count,
+                                      unsigned char* out) const {
+        const unsigned chunk = 1024;
+        for (unsigned begin = 0; begin < count; begin += chunk) {
+            unsigned end = std::min(count, begin + chunk);
+            unsigned before;
+            do {
+                before = read_begin();
+                for (unsigned k = begin; k < end; k++) {
+                    out[k] = labels[pairs[k].first].load(std::memory_order_relaxed)
+                             == labels[pairs[k].second].load(std::memory_order_relaxed);
+                }
+            } while (!read_end(before));
+        }
+    }
+
+    unsigned ComponentIndex::component(unsigned v) const {
+        return labels[v].load(std::memory_order_relaxed);
+    }
+
+    unsigned ComponentIndex::size(unsigned v) const {
+        while (true) {
+            unsigned before = read_begin();
+            unsigned size = sizes[labels[v].load(std::memory_order_relaxed)].load(std::memory_order_relaxed);
+            if (read_end(before)) {
+                return size;
+            }
+        }
+    }
+
+    unsigned ComponentIndex::degree(unsigned v) const {
+        return degrees[v].load(std::memory_order_relaxed);
+    }
+
+    unsigned ComponentIndex::components() const {
+        return count.load(std::memory_order_relaxed);
+    }
+}
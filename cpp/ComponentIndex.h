@@ -0,0 +1,64 @@
+#ifndef DGRAPH_COMPONENTINDEX_H
+#define DGRAPH_COMPONENTINDEX_H
+
+#include <atomic>
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace dgraph {
+    // a component label per vertex with the size of every label and the
+    // degree of every vertex. One thread writes it and relabels the smaller
+    // side when components merge or split, which also makes it a union-find
+    // with constant time finds; any number of threads read it,
+    // validating against a sequence counter instead of taking a lock, so
+    // readers never hold the writer up
+    class ComponentIndex {
+        std::vector<std::atomic<unsigned>> labels;
+        std::vector<std::atomic<unsigned>> sizes;
+        std::vector<std::atomic<unsigned>> degrees;
+        std::vector<unsigned> free_labels;
+        // circular lists of the vertices of each label
+        std::vector<unsigned> next;
+        std::vector<unsigned> prev;
+        std::vector<unsigned> heads;
+        std::atomic<unsigned> count;
+        std::atomic<unsigned> version;
+
+        void begin();
+        void end();
+        unsigned read_begin() const;
+        bool read_end(unsigned before) const;
+
+    public:
+        explicit ComponentIndex(unsigned n);
+        ComponentIndex(const ComponentIndex&) = delete;
+        ComponentIndex& operator=(const ComponentIndex&) = delete;
+
+        // writer side
+        unsigned label(unsigned v) const;
+        unsigned label_size(unsigned label) const;
+        bool join(unsigned v, unsigned u);
+        void split(unsigned from, const std::vector<unsigned>& moved);
+        void add_degree(unsigned v, int delta);
+        // vertices past the old capacity start as singletons and are
+        // counted once added; not to be called with readers around
+        unsigned capacity() const;
+        void grow(unsigned capacity);
+        void add_vertices(int delta);
+        void save(std::ostream& out) const;
+        // not to be called with readers around
+        void load(std::istream& in);
+
+        // reader side, safe alongside the writer
+        bool is_connected(unsigned v, unsigned u) const;
+        void is_connected(const std::pair<unsigned, unsigned>* pairs, unsigned count, unsigned char* out) const;
+        unsigned component(unsigned v) const;
+        unsigned size(unsigned v) const;
+        unsigned degree(unsigned v) const;
+        unsigned components() const;
+    };
+}
+
+#endif //DGRAPH_COMPONENTINDEX_H
@@ -0,0 +1,54 @@
+#include "DynamicForest.h"
+
+namespace dgraph {
+
+    DynamicForest::DynamicForest(unsigned n) :forest(n) {}
+
+    EdgeToken DynamicForest::add(unsigned v, unsigned u) {
+        if (forest.is_connected(v, u)) {
+            return EdgeToken();
+        }
+        EdgeToken token = tokens.acquire();
+        unsigned slot = TokenPool::slot(token);
+        if (slot == handles.size()) {
+            handles.emplace_back();
+            ends.emplace_back();
+        }
+        handles[slot] = forest.link(v, u);
+        ends[slot] = std::make_pair(v, u);
+        forest.increment_tree_edges(v);
+        forest.increment_tree_edges(u);
+        return token;
+    }
+
+    void DynamicForest::remove(EdgeToken&& token) {
+        if (contains(token)) {
+            unsigned slot = TokenPool::slot(token);
+            forest.decrement_tree_edges(ends[slot].first);
+            forest.decrement_tree_edges(ends[slot].second);
+            forest.cut(std::move(handles[slot]));
+            tokens.release(slot);
+        }
+        token = EdgeToken();
+    }
+
+    bool DynamicForest::contains(const EdgeToken& token) const {
+        return tokens.contains(token);
+    }
+
+    bool DynamicForest::is_connected(unsigned v, unsigned u) {
+        return forest.is_connected(v, u);
+    }
+
+    bool DynamicForest::is_connected() {
+        return forest.is_connected();
+    }
+
+    unsigned DynamicForest::component_size(unsigned v) {
+        return forest.component_size(v);
+    }
+
+    unsigned DynamicForest::degree(unsigned v) {
+        return forest.degree(v);
+    }
+}
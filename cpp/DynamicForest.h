@@ -0,0 +1,37 @@
+#ifndef DGRAPH_DYNAMICFOREST_H
+#define DGRAPH_DYNAMICFOREST_H
+
+#include "DynamicGraph.h"
+#include "EulerTourForest.h"
+#include "TokenPool.h"
+
+#include <utility>
+#include <vector>
+
+namespace dgraph {
+    // a graph known to stay acyclic: its edges are the tree edges of a
+    // single Euler tour forest, with no levels and no non-tree edges, so a
+    // link or a cut is one tour operation and a removal never searches
+    class DynamicForest {
+        EulerTourForest forest;
+        std::vector<TreeEdge> handles;
+        std::vector<std::pair<unsigned, unsigned>> ends;
+        TokenPool tokens;
+    public:
+        explicit DynamicForest(unsigned n);
+        DynamicForest(const DynamicForest&) = delete;
+        DynamicForest& operator=(const DynamicForest&) = delete;
+
+        // an empty token if v and u are connected already, the edge would
+        // close a cycle
+        EdgeToken add(unsigned v, unsigned u);
+        void remove(EdgeToken&&);
+        bool contains(const EdgeToken&) const;
+        bool is_connected(unsigned v, unsigned u);
+        bool is_connected();
+        unsigned component_size(unsigned v);
+        unsigned degree(unsigned v);
+    };
+}
+
+#endif //DGRAPH_DYNAMICFOREST_H
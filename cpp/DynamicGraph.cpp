@@ -1,264 +1,1224 @@
 #include "DynamicGraph.h"
 
-#include <cmath>
+#include "Snapshot.h"
+#include "UpdateLog.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
 #include <utility>
-#include <limits>
 #include <iostream>
 
 namespace dgraph {
+    namespace {
+        // a small graph whose rows hold more than SMALL_WORDS words and more
+        // than ROW_WORDS for each of its edges goes onto the levels, where an
+        // edge takes a few dozen bytes
+        const std::size_t SMALL_WORDS = 1 << 15;
+        const std::size_t ROW_WORDS = 32;
+
+        // union-find with path halving over the few trees an update touches
+        unsigned find_set(vector<unsigned>& parent, unsigned x) {
+            while (parent[x] != x) {
+                parent[x] = parent[parent[x]];
+                x = parent[x];
+            }
+            return x;
+        }
+
+        // dense index of a tree name, a new singleton set on first sight
+        unsigned index_of(IndexMap<unsigned>& names, vector<unsigned>& parent, unsigned name) {
+            unsigned* found = names.find(name);
+            if (found != nullptr) {
+                return *found;
+            }
+            unsigned index = static_cast<unsigned>(parent.size());
+            parent.push_back(index);
+            names.insert(name, std::move(index));
+            return parent.back();
+        }
+
+        // spreads [0, count) over the pool, or runs it here without one
+        void run(ThreadPool* pool, unsigned count, const std::function<void(unsigned, unsigned)>& body,
+                 unsigned grain = 1024) {
+            if (pool == nullptr) {
+                body(0, count);
+            } else {
+                pool->parallel_for(0, count, body, grain);
+            }
+        }
+    }
+
+    const unsigned DynamicGraph::SMALL_LIMIT;
+
+    DynamicGraph::DynamicGraph(unsigned n) : n(n), index(n), samples(16), budget(64), stats{0, 0, 0, 0},
+                                             marks(n, 0), stamp(0), deferred(false), log(nullptr), indexed(false),
+                                             vacant(n, 0), small(n <= SMALL_LIMIT), bits(small ? n : 0) {
+        levels.emplace_back();
+        indexed = small;
+    }
+
+    DynamicGraph::DynamicGraph(unsigned n, const vector<std::pair<unsigned, unsigned>>& edges,
+                               vector<EdgeToken>& tokens) : DynamicGraph(n) {
+        this->edges.reserve(edges.size());
+        if (!small) {
+            levels[0].local.reserve(n);
+        }
+        insert_only();
+        tokens = add_batch(edges);
+        build_forests();
+    }
+
+    Level& DynamicGraph::level(unsigned i) {
+        while (levels.size() <= i) {
+            levels.emplace_back();
+        }
+        return levels[i];
+    }
+
+    unsigned DynamicGraph::touch(unsigned i, unsigned v) {
+        Level& lvl = level(i);
+        unsigned* found = lvl.local.find(v);
+        if (found != nullptr) {
+            return *found;
+        }
+        unsigned local = lvl.forest.add_vertex();
+        lvl.local.insert(v, std::move(local));
+        lvl.global.push_back(v);
+        lvl.adj.emplace_back();
+        lvl.tree_adj.emplace_back();
+        return local;
+    }
+
+
+    unsigned DynamicGraph::find(unsigned i, unsigned v) {
+        if (i >= levels.size()) {
+            return NIL;
+        }
+        unsigned* local = levels[i].local.find(v);
+        return local == nullptr ? NIL : *local;
+    }
+
+    unsigned DynamicGraph::create_edge(unsigned v, unsigned u) {
+        index.add_degree(v, 1);
+        index.add_degree(u, 1);
+        unsigned id;
+        if (free_edges.empty()) {
+            id = static_cast<unsigned>(edges.size());
+            edges.emplace_back(v, u);
+            generations.push_back(0);
+        } else {
+            id = free_edges.back();
+            free_edges.pop_back();
+            edges[id] = Edge(v, u);
+        }
+        if (indexed) {
+            pairs.insert(edges, id);
+        }
+        return id;
+    }
+
+    void DynamicGraph::destroy_edge(unsigned id) {
+        if (indexed) {
+            pairs.erase(edges, id);
+        }
+        index.add_degree(edges[id].v, -1);
+        index.add_degree(edges[id].u, -1);
+        // a slot whose generation would wrap around is retired instead, so
+        // that no token of its first edges names it again
+        edges[id] = Edge();
+        if (++generations[id] != ~0u) {
+            free_edges.push_back(id);
+        }
+    }
+
+    bool DynamicGraph::contains(const EdgeToken& token) {
+        return token.edge < edges.size() && generations[token.edge] == token.generation
+               && edges[token.edge].v != NIL;
+    }
 
-    DynamicGraph::DynamicGraph(unsigned n) : n(n) {
-        size = std::lround(std::ceil(std::log2(n)) + 1);
-        for (unsigned i = 0; i < size; i++) {
-            forests.emplace_back(n);
-            adjLists.emplace_back();
-            for (unsigned j = 0; j < n; j++){
-                adjLists[i].push_back(new List());
+    unsigned DynamicGraph::add_vertex() {
+        if (log != nullptr) {
+            log->vertex_added();
+        }
+        unsigned v;
+        if (!free_vertices.empty()) {
+            v = free_vertices.back();
+            free_vertices.pop_back();
+        } else {
+            v = n++;
+            if (n > index.capacity()) {
+                index.grow(std::max(16u, 2 * index.capacity()));
+            }
+            marks.push_back(0);
+            vacant.push_back(1);
+            if (small && n > SMALL_LIMIT) {
+                use_levels();
+            } else if (small) {
+                bits.resize(n);
             }
         }
+        vacant[v] = 0;
+        index.add_vertices(1);
+        return v;
     }
 
-    DynamicGraph::~DynamicGraph() {
-        for (unsigned i = 0; i < size; i++) {
-            for (unsigned j = 0; j < n; j++) {
-                ListIterator it = adjLists[i][j]->iterator();
-                while (it.hasNext()) {
-                    List* list = *it;
-                    it++;
-                    delete list->e();
+    void DynamicGraph::remove_vertex(unsigned v) {
+        if (v >= n || vacant[v]) {
+            return;
+        }
+        if (log != nullptr) {
+            log->vertex_removed(v);
+        }
+        build_forests();
+        vector<EdgeToken> tokens;
+        if (small) {
+            vector<unsigned> others;
+            bits.neighbours(v, others);
+            for (unsigned u : others) {
+                for (unsigned id = pairs.find(edges, v, u); id != NIL; id = pairs.next(id)) {
+                    tokens.push_back(EdgeToken(id, generations[id]));
+                }
+            }
+        }
+        for (unsigned i = 0; i < levels.size(); i++) {
+            unsigned local = find(i, v);
+            if (local == NIL) {
+                continue;
+            }
+            for (const vector<unsigned>* list : {&levels[i].adj[local], &levels[i].tree_adj[local]}) {
+                for (unsigned id : *list) {
+                    tokens.push_back(EdgeToken(id, generations[id]));
                 }
-                delete *it;
             }
         }
+        erase_batch(tokens, nullptr);
+        vacant[v] = 1;
+        free_vertices.push_back(v);
+        index.add_vertices(-1);
+    }
+
+    void DynamicGraph::reserve_vertices(unsigned capacity) {
+        if (small && capacity > SMALL_LIMIT) {
+            use_levels();
+        }
+        if (capacity > index.capacity()) {
+            index.grow(capacity);
+        }
+    }
+
+    // the bits hold a spanning forest agreeing with the labels, which is
+    // what an insert-only stretch leaves too, so the levels are built the
+    // same way. The switch is logged, since the levels free the slots of a
+    // batch in another order than the bits and later tokens depend on it
+    void DynamicGraph::use_levels() {
+        if (!small) {
+            return;
+        }
+        if (log != nullptr) {
+            log->use_levels();
+        }
+        small = false;
+        bits = BitsetGraph();
+        for (unsigned id = 0; id < edges.size(); id++) {
+            if (edges[id].v != NIL) {
+                pending.push_back(id);
+            }
+        }
+        // an insert-only stretch going on carries on over the levels
+        if (!deferred) {
+            deferred = true;
+            build_forests();
+        }
+    }
+
+    bool DynamicGraph::on_levels() const {
+        return !small;
+    }
+
+    void DynamicGraph::index_pairs() {
+        if (indexed) {
+            return;
+        }
+        indexed = true;
+        for (unsigned id = 0; id < edges.size(); id++) {
+            if (edges[id].v != NIL) {
+                pairs.insert(edges, id);
+            }
+        }
+    }
+
+    bool DynamicGraph::remove(unsigned v, unsigned u) {
+        index_pairs();
+        unsigned id = pairs.find(edges, v, u);
+        if (id == NIL) {
+            return false;
+        }
+        remove(EdgeToken(id, generations[id]));
+        return true;
+    }
+
+    bool DynamicGraph::has_edge(unsigned v, unsigned u) {
+        index_pairs();
+        return pairs.find(edges, v, u) != NIL;
+    }
+
+    unsigned DynamicGraph::multiplicity(unsigned v, unsigned u) {
+        index_pairs();
+        unsigned count = 0;
+        for (unsigned id = pairs.find(edges, v, u); id != NIL; id = pairs.next(id)) {
+            count++;
+        }
+        return count;
     }
 
     EdgeToken DynamicGraph::add(unsigned v, unsigned u) {
+        if (log != nullptr && v != u) {
+            log->added(v, u);
+        }
+        return insert(v, u);
+    }
+
+    EdgeToken DynamicGraph::insert(unsigned v, unsigned u) {
         if (v == u) {
-            return EdgeToken(nullptr);
+            return EdgeToken();
+        }
+        unsigned id = create_edge(v, u);
+        if (small) {
+            small_insert(id);
+            return EdgeToken(id, generations[id]);
+        }
+        if (deferred) {
+            if (index.join(v, u)) {
+                edges[id].tree = 1;
+            }
+            pending.push_back(id);
+            return EdgeToken(id, generations[id]);
+        }
+        touch(0, v);
+        touch(0, u);
+        if (index.label(v) != index.label(u)) {
+            link(id, 0);
+        }
+        attach(id);
+        return EdgeToken(id, generations[id]);
+    }
+
+    vector<EdgeToken> DynamicGraph::add_batch(const vector<std::pair<unsigned, unsigned>>& batch) {
+        if (log != nullptr) {
+            log->added(batch);
+        }
+        return insert_batch(batch, nullptr);
+    }
+
+    vector<EdgeToken> DynamicGraph::add_batch(const vector<std::pair<unsigned, unsigned>>& batch, ThreadPool& pool) {
+        if (log != nullptr) {
+            log->added(batch);
+        }
+        return insert_batch(batch, &pool);
+    }
+
+    // only the parts reading the forests are spread over the pool, updates
+    // are applied in batch order, so the outcome is the sequential one
+    vector<EdgeToken> DynamicGraph::insert_batch(const vector<std::pair<unsigned, unsigned>>& batch,
+                                                 ThreadPool* pool) {
+        vector<EdgeToken> tokens(batch.size());
+        if (deferred || small) {
+            for (unsigned k = 0; k < batch.size(); k++) {
+                tokens[k] = insert(batch[k].first, batch[k].second);
+            }
+            return tokens;
+        }
+        for (const auto& e : batch) {
+            if (e.first != e.second) {
+                touch(0, e.first);
+                touch(0, e.second);
+            }
+        }
+        // the trees are named by their labels before anything is linked and a
+        // union-find over the names picks the edges joining two of them; the rest,
+        // repeated pairs included, only go to the adjacency vectors
+        Level& top = levels[0];
+        vector<unsigned> trees(2 * batch.size());
+        run(pool, static_cast<unsigned>(batch.size()), [&](unsigned from, unsigned to) {
+            for (unsigned k = from; k < to; k++) {
+                if (batch[k].first != batch[k].second) {
+                    trees[2 * k] = index.label(batch[k].first);
+                    trees[2 * k + 1] = index.label(batch[k].second);
+                }
+            }
+        });
+        IndexMap<unsigned> names;
+        vector<unsigned> parent;
+        vector<unsigned> ids;
+        ids.reserve(batch.size());
+        for (unsigned k = 0; k < batch.size(); k++) {
+            unsigned v = batch[k].first;
+            unsigned u = batch[k].second;
+            if (v == u) {
+                continue;
+            }
+            unsigned a = find_set(parent, index_of(names, parent, trees[2 * k]));
+            unsigned b = find_set(parent, index_of(names, parent, trees[2 * k + 1]));
+            unsigned id = create_edge(v, u);
+            if (a != b) {
+                parent[a] = b;
+                edges[id].tree = 1;
+            }
+            tokens[k] = EdgeToken(id, generations[id]);
+            ids.push_back(id);
         }
-        unsigned n = size - 1;
-        auto* edge = new Edge(n, v, u);
-        if (!is_connected(v, u)) {
-            edge->add_tree_edge(forests[n].link(v, u));
+
+        vector<std::pair<unsigned, unsigned>> ends[2];
+        for (unsigned id : ids) {
+            Edge& e = edges[id];
+            if (e.tree) {
+                link(id, 0);
+            }
+            place(id);
+            ends[e.tree].emplace_back(0, *top.local.find(e.v));
+            ends[e.tree].emplace_back(0, *top.local.find(e.u));
         }
-        forests[n].increment_edges(v);
-        forests[n].increment_edges(u);
-        edge->subscribe(adjLists[n][v]->add(u, edge), adjLists[n][u]->add(v, edge));
-        return EdgeToken(edge);
+        add_counts(ends[0], true, false);
+        add_counts(ends[1], true, true);
+        return tokens;
     }
 
     void DynamicGraph::remove(EdgeToken&& edge_token) {
-        Edge* link = edge_token.edge;
-        edge_token.edge = nullptr;
-        if (link == nullptr) {
+        if (!contains(edge_token)) {
+            edge_token = EdgeToken();
+            return;
+        }
+        if (log != nullptr) {
+            log->removed(edge_token);
+        }
+        unsigned id = edge_token.edge;
+        edge_token = EdgeToken();
+        if (small) {
+            small_erase(id);
+            check_density();
+            return;
+        }
+        build_forests();
+        vector<Cut> cuts;
+        erase(id, cuts);
+        if (!cuts.empty() && budget > 0) {
+            Probe found = probe(cuts[0]);
+            if (found == Probe::replaced) {
+                return;
+            }
+            if (found == Probe::split) {
+                split_components(cuts, nullptr);
+                return;
+            }
+        }
+        reconnect(cuts, nullptr);
+    }
+
+    void DynamicGraph::remove_batch(vector<EdgeToken>& tokens) {
+        if (log != nullptr) {
+            log->removed(tokens);
+        }
+        erase_batch(tokens, nullptr);
+    }
+
+    void DynamicGraph::remove_batch(vector<EdgeToken>& tokens, ThreadPool& pool) {
+        if (log != nullptr) {
+            log->removed(tokens);
+        }
+        erase_batch(tokens, &pool);
+    }
+
+    void DynamicGraph::erase_batch(vector<EdgeToken>& tokens, ThreadPool* pool) {
+        if (small) {
+            for (const EdgeToken& token : tokens) {
+                if (contains(token)) {
+                    small_erase(token.edge);
+                }
+            }
+            tokens.clear();
+            check_density();
+            return;
+        }
+        build_forests();
+        // non-tree edges go first, with one count update per vertex
+        vector<std::pair<unsigned, unsigned>> ends;
+        for (const EdgeToken& token : tokens) {
+            if (contains(token) && !edges[token.edge].tree) {
+                Edge& e = edges[token.edge];
+                Level& lvl = levels[e.lvl];
+                ends.emplace_back(e.level(), *lvl.local.find(e.v));
+                ends.emplace_back(e.level(), *lvl.local.find(e.u));
+                unplace(token.edge);
+                destroy_edge(token.edge);
+            }
+        }
+        add_counts(ends, false, false);
+        // then all tree edges are cut and searched for replacements at once
+        ends.clear();
+        vector<Cut> cuts;
+        for (const EdgeToken& token : tokens) {
+            if (contains(token)) {
+                Edge& e = edges[token.edge];
+                Level& lvl = levels[e.lvl];
+                ends.emplace_back(e.level(), *lvl.local.find(e.v));
+                ends.emplace_back(e.level(), *lvl.local.find(e.u));
+                unplace(token.edge);
+                drop(token.edge, cuts);
+            }
+        }
+        add_counts(ends, false, true);
+        tokens.clear();
+        reconnect(cuts, pool);
+    }
+
+    void DynamicGraph::add_counts(vector<std::pair<unsigned, unsigned>>& ends, bool increment, bool tree) {
+        std::sort(ends.begin(), ends.end());
+        for (unsigned k = 0; k < ends.size();) {
+            unsigned run = 1;
+            while (k + run < ends.size() && ends[k + run] == ends[k]) run++;
+            EulerTourForest& forest = levels[ends[k].first].forest;
+            if (tree && increment) {
+                forest.increment_tree_edges(ends[k].second, run);
+            } else if (tree) {
+                forest.decrement_tree_edges(ends[k].second, run);
+            } else if (increment) {
+                forest.increment_edges(ends[k].second, run);
+            } else {
+                forest.decrement_edges(ends[k].second, run);
+            }
+            k += run;
+        }
+    }
+
+    void DynamicGraph::insert_only() {
+        if (log != nullptr) {
+            log->insert_only();
+        }
+        deferred = true;
+    }
+
+    vector<unsigned char> DynamicGraph::replay(const vector<TraceStep>& trace) {
+        vector<unsigned char> answers;
+        for (const TraceStep& step : trace) {
+            switch (step.kind) {
+                case TraceStep::Kind::add:
+                    add(step.v, step.u);
+                    break;
+                case TraceStep::Kind::remove:
+                    remove(step.v, step.u);
+                    break;
+                case TraceStep::Kind::query:
+                    answers.push_back(is_connected(step.v, step.u));
+                    break;
+            }
+        }
+        return answers;
+    }
+
+    void DynamicGraph::set_log(UpdateLog* log) {
+        this->log = log;
+    }
+
+    void DynamicGraph::small_insert(unsigned id) {
+        Edge& e = edges[id];
+        bits.set_edge(e.v, e.u, true);
+        if (index.join(e.v, e.u)) {
+            e.tree = 1;
+            bits.set_tree_edge(e.v, e.u, true);
+        }
+    }
+
+    // checked as edges go rather than as they come, so a graph filling up
+    // is not moved before it gets dense
+    void DynamicGraph::check_density() {
+        std::size_t live = edges.size() - free_edges.size();
+        if (bits.words() > SMALL_WORDS && bits.words() > ROW_WORDS * live) {
+            use_levels();
+        }
+    }
+
+    // a parallel edge left behind takes over as the forest edge of the
+    // pair; otherwise the smaller tree is searched for an edge leaving it
+    // and split off if there is none
+    void DynamicGraph::small_erase(unsigned id) {
+        unsigned v = edges[id].v;
+        unsigned u = edges[id].u;
+        bool tree = edges[id].tree;
+        destroy_edge(id);
+        unsigned other = pairs.find(edges, v, u);
+        if (other != NIL) {
+            if (tree) {
+                edges[other].tree = 1;
+            }
+            return;
+        }
+        bits.set_edge(v, u, false);
+        if (!tree) {
+            return;
+        }
+        bits.set_tree_edge(v, u, false);
+        const vector<unsigned>& side = bits.smaller_tree(v, u);
+        unsigned x;
+        unsigned y;
+        if (bits.leaving(x, y)) {
+            unsigned replacement = pairs.find(edges, x, y);
+            edges[replacement].tree = 1;
+            bits.set_tree_edge(x, y, true);
+        } else {
+            index.split(index.label(v), side);
+        }
+    }
+
+    void DynamicGraph::build_forests() {
+        if (!deferred) {
+            return;
+        }
+        deferred = false;
+        Level& top = levels[0];
+        bool fresh = top.tree_edges.size() == 0;
+        for (unsigned id : pending) {
+            touch(0, edges[id].v);
+            touch(0, edges[id].u);
+            place(id);
+        }
+        // counted while the vertices are singletons yet, so a fresh forest
+        // gets its sums from the build
+        unsigned vertices = top.forest.vertices();
+        vector<unsigned> counts[2] = {vector<unsigned>(vertices, 0), vector<unsigned>(vertices, 0)};
+        for (unsigned id : pending) {
+            counts[edges[id].tree][*top.local.find(edges[id].v)]++;
+            counts[edges[id].tree][*top.local.find(edges[id].u)]++;
+        }
+        for (unsigned local = 0; local < vertices; local++) {
+            if (counts[0][local] > 0) {
+                top.forest.increment_edges(local, counts[0][local]);
+            }
+            if (counts[1][local] > 0) {
+                top.forest.increment_tree_edges(local, counts[1][local]);
+            }
+        }
+        if (fresh) {
+            vector<std::pair<unsigned, unsigned>> forest;
+            vector<unsigned> ids;
+            for (unsigned id : pending) {
+                if (edges[id].tree) {
+                    forest.emplace_back(*top.local.find(edges[id].v), *top.local.find(edges[id].u));
+                    ids.push_back(id);
+                }
+            }
+            vector<TreeEdge> occurrences = top.forest.build(forest);
+            for (unsigned k = 0; k < ids.size(); k++) {
+                top.tree_edges.insert(ids[k], std::move(occurrences[k]));
+            }
+        } else {
+            // the labels were joined as the edges came in
+            for (unsigned id : pending) {
+                if (edges[id].tree) {
+                    link(id, 0);
+                }
+            }
+        }
+        pending.clear();
+        pending.shrink_to_fit();
+    }
+
+    void DynamicGraph::erase(unsigned id, vector<Cut>& cuts) {
+        detach(id);
+        drop(id, cuts);
+    }
+
+    // cuts a detached edge out of the forests and frees its slot
+    void DynamicGraph::drop(unsigned id, vector<Cut>& cuts) {
+        Edge& edge = edges[id];
+        if (edge.is_tree_edge()) {
+            cuts.push_back({edge.v, edge.u, edge.lvl});
+            for (unsigned i = 0; i <= edge.lvl; i++){
+                levels[i].forest.cut(levels[i].tree_edges.take(id));
+            }
+        }
+        destroy_edge(id);
+    }
+
+    void DynamicGraph::reconnect(const vector<Cut>& cuts, ThreadPool* pool) {
+        if (cuts.empty()) {
+            return;
+        }
+        unsigned depth = 0;
+        for (const Cut& cut : cuts) {
+            depth = std::max(depth, cut.depth);
+        }
+        for (unsigned i = depth + 1; i-- > 0;) {
+            reconnect(i, cuts, pool);
+        }
+        split_components(cuts, pool);
+    }
+
+    void DynamicGraph::reconnect(unsigned i, const vector<Cut>& cuts, ThreadPool* pool) {
+        Level& lvl = levels[i];
+        EulerTourForest& forest = lvl.forest;
+        vector<unsigned> trees(2 * cuts.size(), NIL);
+        run(pool, static_cast<unsigned>(cuts.size()), [&](unsigned from, unsigned to) {
+            for (unsigned k = from; k < to; k++) {
+                if (cuts[k].depth >= i) {
+                    trees[2 * k] = forest.tree_id(*lvl.local.find(cuts[k].v));
+                    trees[2 * k + 1] = forest.tree_id(*lvl.local.find(cuts[k].u));
+                }
+            }
+        });
+        bool split = false;
+        for (unsigned k = 0; k < cuts.size() && !split; k++) {
+            split = trees[2 * k] != trees[2 * k + 1];
+        }
+        if (!split) {
             return;
         }
 
-        unsigned v = link->from();
-        unsigned u = link->to();
-        bool complex_deletion = link->is_tree_edge();
-        unsigned level = link->level();
+        // the pieces the cuts left at this level, grouped by the tree of the
+        // level they used to form
+        IndexMap<unsigned> names;
+        vector<unsigned> parent;
+        vector<unsigned> pieces;
+        for (unsigned k = 0; k < cuts.size(); k++) {
+            if (cuts[k].depth < i) {
+                continue;
+            }
+            unsigned ends[2] = {cuts[k].v, cuts[k].u};
+            unsigned p[2];
+            for (unsigned j = 0; j < 2; j++) {
+                p[j] = index_of(names, parent, trees[2 * k + j]);
+                if (p[j] == pieces.size()) {
+                    pieces.push_back(*lvl.local.find(ends[j]));
+                }
+            }
+            unsigned a = find_set(parent, p[0]);
+            unsigned b = find_set(parent, p[1]);
+            if (a != b) {
+                parent[a] = b;
+            }
+        }
+        vector<unsigned> sizes(pieces.size());
+        vector<unsigned> total(pieces.size(), 0);
+        vector<unsigned> count(pieces.size(), 0);
+        for (unsigned p = 0; p < pieces.size(); p++) {
+            sizes[p] = forest.component_size(pieces[p]);
+            unsigned group = find_set(parent, p);
+            total[group] += sizes[p];
+            count[group]++;
+        }
+        vector<unsigned> queue;
+        for (unsigned p = 0; p < pieces.size(); p++) {
+            if (count[find_set(parent, p)] > 1) {
+                queue.push_back(p);
+            }
+        }
+        std::sort(queue.begin(), queue.end(), [&sizes](unsigned a, unsigned b) {
+            return sizes[a] < sizes[b];
+        });
+
+        // only pieces holding at most half of their group are searched, so
+        // pushing their edges down keeps the level bounds; any edge between
+        // two pieces has such a piece on one of its sides. A piece that got
+        // linked to another is searched again as the union
+        for (unsigned k = 0; k < queue.size(); k++) {
+            unsigned p = queue[k];
+            if (2 * forest.component_size(pieces[p]) > total[find_set(parent, p)]) {
+                continue;
+            }
+            if (scan(i, pieces[p])) {
+                queue.push_back(p);
+            }
+        }
+    }
+
+    void DynamicGraph::set_sampling(unsigned samples) {
+        if (log != nullptr) {
+            log->sampling(samples);
+        }
+        this->samples = samples;
+    }
 
-        if (complex_deletion) {
-            for (unsigned i = 0; i <= size - level - 1; i++){
-                forests[size - i - 1].cut(std::move(link->tree_edges[i]));
+    // a few non-tree edge ends drawn uniformly over the tree of local, which
+    // in a dense graph mostly turns up a replacement before any push down
+    bool DynamicGraph::sample(unsigned i, unsigned local) {
+        Level& lvl = levels[i];
+        unsigned ends = lvl.forest.nontree_edges(local);
+        unsigned tries = std::min(samples, ends);
+        for (unsigned k = 0; k < tries; k++) {
+            unsigned rank = std::uniform_int_distribution<unsigned>(0, ends - 1)(rng);
+            unsigned w = lvl.forest.nth_nontree_vertex(local, rank);
+            unsigned id = lvl.adj[w][rank];
+            const Edge& e = edges[id];
+            unsigned other = e.v == lvl.global[w] ? e.u : e.v;
+            if (!lvl.forest.is_connected(local, *lvl.local.find(other))) {
+                replace(id, i);
+                return true;
             }
         }
+        return false;
+    }
 
-        forests[level].decrement_edges(v);
-        forests[level].decrement_edges(u);
+    void DynamicGraph::set_probe_budget(unsigned budget) {
+        if (log != nullptr) {
+            log->probe_budget(budget);
+        }
+        this->budget = budget;
+    }
 
-        delete link;
+    const ProbeStats& DynamicGraph::probe_stats() const {
+        return stats;
+    }
 
-        if (complex_deletion) {
-            for (unsigned i = level; i < size; i++){
-                // find new connection
-                // to do that choose the lesser component
-                if(forests[i].size(v) > forests[i].size(u)){
-                    std::swap(v, u);
+    // a breadth-first search from both ends of the cut in turns, over the
+    // edges of all levels and within the budget. A non-tree edge of the cut's
+    // level joining two trees of that level can only join the two halves of
+    // the cut tree and replaces the cut edge on every level; a side running
+    // out of vertices shows the component split. Meeting the other side some
+    // other way says nothing about where the replacement is
+    DynamicGraph::Probe DynamicGraph::probe(const Cut& cut) {
+        stats.runs++;
+        if (stamp >= ~0u - 2) {
+            std::fill(marks.begin(), marks.end(), 0);
+            stamp = 0;
+        }
+        stamp += 2;
+        Level& deep = levels[cut.depth];
+        unsigned ends[2] = {cut.v, cut.u};
+        unsigned head[2] = {0, 0};
+        for (unsigned side = 0; side < 2; side++) {
+            frontier[side].clear();
+            frontier[side].push_back(ends[side]);
+            marks[ends[side]] = stamp + side;
+        }
+        // the budget is checked at every edge, a vertex of high degree would
+        // overrun it by its whole adjacency otherwise
+        unsigned spent = 0;
+        for (;;) {
+            for (unsigned side = 0; side < 2; side++) {
+                if (head[side] == frontier[side].size()) {
+                    stats.split++;
+                    return Probe::split;
                 }
-                // and iterate over good vertices until success
-                // propagating all tree edges of smallest component
-                Edge* replacement = nullptr;
-                Iterator it = forests[i].iterator(v);
-                while(it.hasNext()){
-                    unsigned w = *it;
-                    ListIterator lit = adjLists[i][w]->iterator();
-                    while(lit.hasNext()){
-                        List* l = *(lit++);
-                        Edge* e = l->e();
-                        unsigned up = l->vertex();
-                        if (e->is_tree_edge()) {
-                            downgrade(e);
-                        } else {
-                            if (replacement != nullptr) {
-                                break;
+                unsigned x = frontier[side][head[side]++];
+                for (unsigned i = 0; i < levels.size(); i++) {
+                    Level& lvl = levels[i];
+                    unsigned* local = lvl.local.find(x);
+                    if (local == nullptr) {
+                        continue;
+                    }
+                    for (unsigned tree = 0; tree < 2; tree++) {
+                        const vector<unsigned>& adj = tree ? lvl.tree_adj[*local] : lvl.adj[*local];
+                        for (unsigned id : adj) {
+                            if (spent == budget) {
+                                return Probe::unknown;
+                            }
+                            spent++;
+                            stats.scanned++;
+                            const Edge& e = edges[id];
+                            unsigned y = e.v == x ? e.u : e.v;
+                            if (!tree && i == cut.depth
+                                && !deep.forest.is_connected(*local, *deep.local.find(y))) {
+                                replace(id, i);
+                                stats.replaced++;
+                                return Probe::replaced;
                             }
-                            if (is_connected(up, u)) {
-                                replacement = e;
-                            } else {
-                                downgrade(e);
+                            if (marks[y] == stamp + 1 - side) {
+                                return Probe::unknown;
+                            }
+                            if (marks[y] != stamp + side) {
+                                marks[y] = stamp + side;
+                                frontier[side].push_back(y);
                             }
                         }
                     }
-                    ++it;
-                }
-
-                if (replacement != nullptr) {
-                    for (unsigned j = size - 1; j >= i; j--){
-                        replacement->add_tree_edge(forests[j].link(replacement->v, replacement->u));
-                    }
-                    break;
                 }
             }
         }
     }
 
-    void DynamicGraph::downgrade(Edge* e){
-        unsigned v = e->from();
-        unsigned w = e->to();
-        unsigned lvl = e->lvl--;
-        e->removeLinks();
-        e->subscribe(adjLists[lvl - 1][w]->add(v, e), adjLists[lvl - 1][v]->add(w, e));
-        forests[lvl].decrement_edges(w);
-        forests[lvl].decrement_edges(v);
-        forests[lvl - 1].increment_edges(w);
-        forests[lvl - 1].increment_edges(v);
-        if (e->is_tree_edge()) {
-            e->add_tree_edge(forests[lvl - 1].link(v, w));
+    void DynamicGraph::replace(unsigned id, unsigned i) {
+        detach(id);
+        for (unsigned j = 0; j <= i; j++) {
+            link(id, j);
         }
+        attach(id);
     }
 
-    bool DynamicGraph::is_connected(unsigned v, unsigned u) {
-        return forests[forests.size() - 1].is_connected(v, u);
+    bool DynamicGraph::scan(unsigned i, unsigned local) {
+        if (samples > 0 && sample(i, local)) {
+            return true;
+        }
+        Level& lvl = levels[i];
+        // look for a non-tree edge leaving the tree of local, pushing the ones
+        // that stay inside one level down; before the first of them goes,
+        // the tree edges of this level are pushed so the tree exists below
+        bool pushed = false;
+        unsigned w;
+        while ((w = lvl.forest.find_nontree_vertex(local)) != NIL) {
+            vector<unsigned>& adj = lvl.adj[w];
+            while (!adj.empty()) {
+                unsigned id = adj.back();
+                const Edge& e = edges[id];
+                unsigned other = e.v == lvl.global[w] ? e.u : e.v;
+                if (!lvl.forest.is_connected(local, *lvl.local.find(other))) {
+                    replace(id, i);
+                    return true;
+                }
+                if (!pushed) {
+                    push_tree_edges(i, local);
+                    pushed = true;
+                }
+                downgrade(id);
+            }
+        }
+        if (!pushed) {
+            push_tree_edges(i, local);
+        }
+        return false;
     }
 
-    bool DynamicGraph::is_connected() {
-        return forests[forests.size() - 1].is_connected();
+    void DynamicGraph::push_tree_edges(unsigned i, unsigned local) {
+        Level& lvl = levels[i];
+        unsigned w;
+        while ((w = lvl.forest.find_tree_vertex(local)) != NIL) {
+            vector<unsigned>& adj = lvl.tree_adj[w];
+            while (!adj.empty()) {
+                downgrade(adj.back());
+            }
+        }
     }
 
-    std::string DynamicGraph::str() {
-        std::string str;
-        for(unsigned i = 0; i < size; i++){
-            str += "level " + std::to_string(i) + ": \n";
-            str += forests[i].str() + "\n";
+    void DynamicGraph::downgrade(unsigned id){
+        Edge& e = edges[id];
+        unsigned lvl = e.lvl;
+        touch(lvl + 1, e.v);
+        touch(lvl + 1, e.u);
+        detach(id);
+        e.lvl++;
+        if (e.is_tree_edge()) {
+            link(id, lvl + 1);
         }
-        return str;
+        attach(id);
     }
 
-    unsigned DynamicGraph::degree(unsigned v) {
-        unsigned sum = 0;
-        for (unsigned i = 0; i < size; i++) {
-            sum += forests[i].degree(v);
+    // labels follow the top level forest, except that a component losing
+    // tree edges keeps its label until the replacement search is over;
+    // a replacement thus links two trees with one label and costs nothing
+    void DynamicGraph::link(unsigned id, unsigned i) {
+        Edge& e = edges[id];
+        Level& lvl = levels[i];
+        if (i == 0) {
+            index.join(e.v, e.u);
         }
-        return sum;
+        e.tree = 1;
+        lvl.tree_edges.insert(id, lvl.forest.link(*lvl.local.find(e.v), *lvl.local.find(e.u)));
     }
 
-    unsigned DynamicGraph::component_size(unsigned v) {
-        return forests[forests.size() - 1].component_size(v);
+    // each label left with several trees keeps the largest one, the others
+    // get fresh labels
+    void DynamicGraph::split_components(const vector<Cut>& cuts, ThreadPool* pool) {
+        Level& top = levels[0];
+        EulerTourForest& forest = top.forest;
+        vector<unsigned> names(2 * cuts.size());
+        run(pool, static_cast<unsigned>(cuts.size()), [&](unsigned from, unsigned to) {
+            for (unsigned k = from; k < to; k++) {
+                names[2 * k] = forest.tree_id(*top.local.find(cuts[k].v));
+                names[2 * k + 1] = forest.tree_id(*top.local.find(cuts[k].u));
+            }
+        });
+        // (label, tree name, vertex) for both ends of the cuts left apart;
+        // every tree a label broke into holds one of them
+        vector<std::tuple<unsigned, unsigned, unsigned>> ends;
+        for (unsigned k = 0; k < cuts.size(); k++) {
+            if (names[2 * k] != names[2 * k + 1]) {
+                ends.emplace_back(index.label(cuts[k].v), names[2 * k], *top.local.find(cuts[k].v));
+                ends.emplace_back(index.label(cuts[k].u), names[2 * k + 1], *top.local.find(cuts[k].u));
+            }
+        }
+        std::sort(ends.begin(), ends.end());
+        // every tree but the largest of its label is relabelled
+        vector<std::pair<unsigned, unsigned>> relabelled;
+        vector<unsigned> trees;
+        for (unsigned k = 0; k < ends.size();) {
+            unsigned label = std::get<0>(ends[k]);
+            trees.clear();
+            for (; k < ends.size() && std::get<0>(ends[k]) == label; k++) {
+                if (trees.empty() || std::get<1>(ends[k]) != std::get<1>(ends[k - 1])) {
+                    trees.push_back(std::get<2>(ends[k]));
+                }
+            }
+            unsigned largest = 0;
+            vector<unsigned> sizes(trees.size());
+            for (unsigned t = 0; t < trees.size(); t++) {
+                sizes[t] = forest.component_size(trees[t]);
+                if (sizes[t] > sizes[largest]) {
+                    largest = t;
+                }
+            }
+            for (unsigned t = 0; t < trees.size(); t++) {
+                if (t != largest) {
+                    relabelled.emplace_back(label, trees[t]);
+                }
+            }
+        }
+        // the walks only read the forest and go over the pool, the labels
+        // are then split in the order a single thread would
+        vector<vector<unsigned>> moved(relabelled.size());
+        run(pool, static_cast<unsigned>(relabelled.size()), [&](unsigned from, unsigned to) {
+            for (unsigned t = from; t < to; t++) {
+                forest.tree_vertices(relabelled[t].second, moved[t]);
+                for (unsigned& w : moved[t]) {
+                    w = top.global[w];
+                }
+            }
+        }, 1);
+        for (unsigned t = 0; t < relabelled.size(); t++) {
+            index.split(relabelled[t].first, moved[t]);
+        }
     }
 
-    List* List::add(unsigned v, Edge* edge) {
-        List* new_list = new List(v, edge, prev, this);
-        prev->next = new_list;
-        prev = new_list;
-        return new_list;
+    void DynamicGraph::attach(unsigned id) {
+        place(id);
+        Edge& e = edges[id];
+        Level& lvl = levels[e.lvl];
+        unsigned ends[2] = {*lvl.local.find(e.v), *lvl.local.find(e.u)};
+        for (unsigned k = 0; k < 2; k++) {
+            if (e.tree) {
+                lvl.forest.increment_tree_edges(ends[k]);
+            } else {
+                lvl.forest.increment_edges(ends[k]);
+            }
+        }
     }
 
-    List::~List() {
-        next->prev = prev;
-        prev->next = next;
+    void DynamicGraph::detach(unsigned id) {
+        Edge& e = edges[id];
+        Level& lvl = levels[e.lvl];
+        unsigned ends[2] = {*lvl.local.find(e.v), *lvl.local.find(e.u)};
+        for (unsigned k = 0; k < 2; k++) {
+            if (e.tree) {
+                lvl.forest.decrement_tree_edges(ends[k]);
+            } else {
+                lvl.forest.decrement_edges(ends[k]);
+            }
+        }
+        unplace(id);
     }
 
-    List::List(unsigned u, Edge* edge, List* prev, List* next) :u(u), edge(edge), prev(prev), next(next){}
-
-    List::List() :edge(nullptr) {
-        next = this;
-        prev = this;
-        u = std::numeric_limits<unsigned>::max();
+    // place and unplace only maintain the adjacency vectors, the forest
+    // counts are left to the caller
+    void DynamicGraph::place(unsigned id) {
+        Edge& e = edges[id];
+        Level& lvl = levels[e.lvl];
+        vector<vector<unsigned>>& adj = e.tree ? lvl.tree_adj : lvl.adj;
+        unsigned ends[2] = {*lvl.local.find(e.v), *lvl.local.find(e.u)};
+        for (unsigned k = 0; k < 2; k++) {
+            e.set_position(k, static_cast<unsigned>(adj[ends[k]].size()));
+            adj[ends[k]].push_back(id);
+        }
     }
 
-    ListIterator List::iterator() {
-        return ListIterator(next);
+    void DynamicGraph::unplace(unsigned id) {
+        Edge& e = edges[id];
+        Level& lvl = levels[e.lvl];
+        vector<vector<unsigned>>& adj = e.tree ? lvl.tree_adj : lvl.adj;
+        unsigned ends[2] = {e.v, e.u};
+        for (unsigned k = 0; k < 2; k++) {
+            vector<unsigned>& list = adj[*lvl.local.find(ends[k])];
+            Edge& last = edges[list.back()];
+            list[e.position(k)] = list.back();
+            last.set_position(last.v == ends[k] ? 0 : 1, e.position(k));
+            list.pop_back();
+        }
     }
 
-    unsigned List::vertex() {
-        return u;
+    bool DynamicGraph::is_connected(unsigned v, unsigned u) const {
+        return v == u || index.is_connected(v, u);
     }
 
-    Edge* List::e() {
-        return edge;
+    bool DynamicGraph::is_connected() const {
+        return index.components() == 1;
     }
 
-    Edge::Edge(unsigned lvl, unsigned v, unsigned u) : lvl(lvl), v(v), u(u) {}
-
-    void Edge::subscribe(List* first, List* second) {
-        first_link = first;
-        second_link = second;
+    vector<unsigned char> DynamicGraph::is_connected(const vector<std::pair<unsigned, unsigned>>& pairs) const {
+        vector<unsigned char> connected(pairs.size());
+        index.is_connected(pairs.data(), static_cast<unsigned>(pairs.size()), connected.data());
+        return connected;
     }
 
-    unsigned Edge::level() {
-        return lvl;
+    unsigned DynamicGraph::component(unsigned v) const {
+        return index.component(v);
     }
 
-    void Edge::removeLinks() {
-        delete first_link;
-        delete second_link;
-        first_link = nullptr;
-        second_link = nullptr;
+    std::string DynamicGraph::str() {
+        build_forests();
+        std::string str;
+        for(unsigned i = 0; i < levels.size(); i++){
+            str += "level " + std::to_string(i) + ": \n";
+            str += levels[i].forest.str() + "\n";
+        }
+        return str;
     }
 
-    unsigned Edge::from() {
-        return v;
+    unsigned DynamicGraph::degree(unsigned v) const {
+        return index.degree(v);
     }
 
-    unsigned Edge::to() {
-        return u;
+    unsigned DynamicGraph::component_size(unsigned v) const {
+        return index.size(v);
     }
 
-    void Edge::add_tree_edge(TreeEdge&& edge) {
-        tree_edges.push_back(std::move(edge));
+    namespace {
+        const std::uint32_t SNAPSHOT_MAGIC = 0x48504744;
+        const std::uint32_t SNAPSHOT_VERSION = 6;
     }
 
-    bool Edge::is_tree_edge() {
-        return !tree_edges.empty();
+    void DynamicGraph::save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("cannot write snapshot " + path);
+        }
+        snapshot::write(out, SNAPSHOT_MAGIC);
+        snapshot::write(out, SNAPSHOT_VERSION);
+        snapshot::write(out, n);
+        snapshot::write(out, static_cast<unsigned>(levels.size()));
+        for (const Level& lvl : levels) {
+            lvl.local.save(out);
+            snapshot::write_array(out, lvl.global);
+            lvl.forest.save(out);
+            snapshot::write_nested(out, lvl.adj);
+            snapshot::write_nested(out, lvl.tree_adj);
+            lvl.tree_edges.save(out);
+        }
+        snapshot::write_array(out, edges);
+        snapshot::write_array(out, generations);
+        snapshot::write_array(out, free_edges);
+        index.save(out);
+        snapshot::write(out, samples);
+        snapshot::write(out, budget);
+        snapshot::write(out, stats);
+        std::ostringstream state;
+        state << rng;
+        std::string text = state.str();
+        snapshot::write_array(out, vector<char>(text.begin(), text.end()));
+        snapshot::write(out, deferred);
+        snapshot::write_array(out, pending);
+        snapshot::write_array(out, free_vertices);
+        snapshot::write(out, small);
+        if (!out) {
+            throw std::runtime_error("cannot write snapshot " + path);
+        }
     }
 
-    Edge::~Edge() {
-        removeLinks();
+    void DynamicGraph::load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("cannot read snapshot " + path);
+        }
+        std::uint32_t magic;
+        std::uint32_t version;
+        snapshot::read(in, magic);
+        snapshot::read(in, version);
+        if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+            throw std::runtime_error("not a version " + std::to_string(SNAPSHOT_VERSION) + " snapshot: " + path);
+        }
+        snapshot::read(in, n);
+        unsigned depth;
+        snapshot::read(in, depth);
+        levels.clear();
+        for (unsigned i = 0; i < depth; i++) {
+            levels.emplace_back();
+            Level& lvl = levels.back();
+            lvl.local.load(in);
+            snapshot::read_array(in, lvl.global);
+            lvl.forest.load(in);
+            snapshot::read_nested(in, lvl.adj);
+            snapshot::read_nested(in, lvl.tree_adj);
+            lvl.tree_edges.load(in);
+        }
+        snapshot::read_array(in, edges);
+        snapshot::read_array(in, generations);
+        if (generations.size() != edges.size()) {
+            throw std::runtime_error("corrupt snapshot " + path);
+        }
+        snapshot::read_array(in, free_edges);
+        index.load(in);
+        snapshot::read(in, samples);
+        snapshot::read(in, budget);
+        snapshot::read(in, stats);
+        vector<char> text;
+        snapshot::read_array(in, text);
+        std::istringstream state(std::string(text.begin(), text.end()));
+        state >> rng;
+        snapshot::read(in, deferred);
+        snapshot::read_array(in, pending);
+        snapshot::read_array(in, free_vertices);
+        snapshot::read(in, small);
+        vacant.assign(n, 0);
+        for (unsigned v : free_vertices) {
+            vacant[v] = 1;
+        }
+        marks.assign(n, 0);
+        stamp = 0;
+        pairs.clear();
+        indexed = false;
+        // the bits and the pair index are laid out again from the pool
+        bits = BitsetGraph(small ? n : 0);
+        if (small) {
+            index_pairs();
+            for (const Edge& e : edges) {
+                if (e.v != NIL) {
+                    bits.set_edge(e.v, e.u, true);
+                    if (e.tree) {
+                        bits.set_tree_edge(e.v, e.u, true);
+                    }
+                }
+            }
+        }
     }
 
-    ListIterator::ListIterator(List* list) :list(list) {}
+    static_assert(sizeof(Edge) == 4 * sizeof(unsigned), "an edge takes four words of the pool");
 
-    ListIterator ListIterator::operator++(int) {
-        ListIterator state(list);
-        list = list->next;
-        return state;
+    Edge::Edge() : Edge(NIL, NIL) {}
+
+    Edge::Edge(unsigned v, unsigned u) : v(v), u(u), first(0), lvl(0), second(0), tree(0) {}
+
+    unsigned Edge::position(unsigned k) const {
+        return k == 0 ? first : second;
     }
 
-    List* ListIterator::operator*() {
-        return list;
+    void Edge::set_position(unsigned k, unsigned p) {
+        if (k == 0) {
+            first = p;
+        } else {
+            second = p;
+        }
     }
 
-    bool ListIterator::hasNext() {
-        return list->edge != nullptr;
+    unsigned Edge::level() {
+        return lvl;
     }
 
-    EdgeToken::EdgeToken(Edge* edge) :edge(edge){}
+    unsigned Edge::from() {
+        return v;
+    }
 
-    EdgeToken::EdgeToken(EdgeToken&& e) noexcept :edge(e.edge){
-        e.edge = nullptr;
+    unsigned Edge::to() {
+        return u;
     }
 
-    EdgeToken& EdgeToken::operator=(EdgeToken&& other) noexcept {
-        edge = other.edge;
-        other.edge = nullptr;
-        return *this;
+    bool Edge::is_tree_edge() {
+        return tree != 0;
     }
 
-    EdgeToken::EdgeToken() :edge(nullptr){}
+    EdgeToken::EdgeToken(unsigned edge, unsigned generation) :edge(edge), generation(generation) {}
+
+    EdgeToken::EdgeToken() :edge(NIL), generation(0) {}
 
-    bool EdgeToken::moved() {
-        return edge == nullptr;
+    bool EdgeToken::moved() const {
+        return edge == NIL;
     }
 }
@@ -1,30 +1,44 @@
 #ifndef DGRAPH_DYNAMICGRAPH_H
 #define DGRAPH_DYNAMICGRAPH_H
 
+#include "BitsetGraph.h"
+#include "ComponentIndex.h"
 #include "EulerTourForest.h"
+#include "IndexMap.h"
+#include "PairIndex.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <deque>
+#include <random>
+#include <utility>
 
 namespace {
     using std::vector;
 }
 
 namespace dgraph {
-    class List;
-    class ListIterator;
     class DynamicGraph;
+    class UpdateLog;
 
+    // v, u and the positions of the edge in both endpoints' adjacency
+    // vectors, with the level and the tree flag in their top bits, so a
+    // vertex holds fewer than 2^26 edges on one level. The Euler tour
+    // occurrences of tree edges are kept by the levels themselves and the
+    // slot generations by the graph, beside the pool
     class Edge {
-        unsigned lvl;
         unsigned v;
         unsigned u;
-        List* first_link;
-        List* second_link;
-        std::vector<TreeEdge> tree_edges;
-        void subscribe(List*, List*);
-        void removeLinks();
-        void add_tree_edge(TreeEdge&&);
+        unsigned first : 26;
+        unsigned lvl : 6;
+        unsigned second : 26;
+        unsigned tree : 1;
+
+        unsigned position(unsigned k) const;
+        void set_position(unsigned k, unsigned p);
     public:
-        explicit Edge(unsigned, unsigned, unsigned);
-        ~Edge();
+        Edge();
+        Edge(unsigned, unsigned);
 
         unsigned from();
         unsigned to();
@@ -32,72 +46,193 @@ namespace dgraph {
         bool is_tree_edge();
 
         friend class DynamicGraph;
+        friend class PairIndex;
     };
 
+    typedef IndexMap<unsigned> VertexMap;
+
+    // levels are counted from the top: new edges enter level 0 and sink
+    // when pushed down, so a level only exists once some edge reached it
+    struct Level {
+        VertexMap local;
+        vector<unsigned> global;
+        EulerTourForest forest;
+        vector<vector<unsigned>> adj;
+        vector<vector<unsigned>> tree_adj;
+        IndexMap<TreeEdge> tree_edges;
+    };
+
+    // edges live in a pool owned by the graph; a token is the slot index plus
+    // the generation of the slot, so a token outliving its edge is detected
     class EdgeToken {
-        Edge* edge;
-        explicit EdgeToken(Edge*);
+        unsigned edge;
+        unsigned generation;
+        EdgeToken(unsigned, unsigned);
     public:
         EdgeToken();
-        EdgeToken(const EdgeToken&) = delete;
-        EdgeToken& operator=(const EdgeToken&) = delete;
-        EdgeToken& operator=(EdgeToken&&) noexcept;
-        EdgeToken(EdgeToken&&) noexcept;
-        ~EdgeToken() = default;
 
-        bool moved();
+        bool moved() const;
 
         friend class DynamicGraph;
+        friend class TokenPool;
+        friend class UpdateLog;
+    };
+
+    // how often the local search ahead of a replacement search settled a
+    // deletion on its own, either finding the replacement or a split, and
+    // the edges it looked at
+    struct ProbeStats {
+        unsigned long long runs;
+        unsigned long long replaced;
+        unsigned long long split;
+        unsigned long long scanned;
     };
 
     class DynamicGraph {
+        // a removed tree edge waiting for its replacement search
+        struct Cut {
+            unsigned v;
+            unsigned u;
+            unsigned depth;
+        };
+
+        enum class Probe {
+            replaced,
+            split,
+            unknown
+        };
+
         unsigned n;
-        unsigned size;
-        vector<EulerTourForest> forests;
-        vector<vector<List*>> adjLists;
-        void downgrade(Edge* e);
+        std::deque<Level> levels;
+        vector<Edge> edges;
+        vector<unsigned> generations;
+        vector<unsigned> free_edges;
+        ComponentIndex index;
+        unsigned samples;
+        std::minstd_rand rng;
+        unsigned budget;
+        ProbeStats stats;
+        vector<unsigned> marks;
+        unsigned stamp;
+        vector<unsigned> frontier[2];
+        bool deferred;
+        vector<unsigned> pending;
+        UpdateLog* log;
+        PairIndex pairs;
+        bool indexed;
+        vector<unsigned> free_vertices;
+        vector<unsigned char> vacant;
+        bool small;
+        BitsetGraph bits;
+        EdgeToken insert(unsigned v, unsigned u);
+        unsigned create_edge(unsigned v, unsigned u);
+        void destroy_edge(unsigned id);
+        void downgrade(unsigned id);
+        void attach(unsigned id);
+        void detach(unsigned id);
+        void place(unsigned id);
+        void unplace(unsigned id);
+        void link(unsigned id, unsigned i);
+        void split_components(const vector<Cut>& cuts, ThreadPool* pool);
+        void erase(unsigned id, vector<Cut>& cuts);
+        void drop(unsigned id, vector<Cut>& cuts);
+        void add_counts(vector<std::pair<unsigned, unsigned>>& ends, bool increment, bool tree);
+        void build_forests();
+        vector<EdgeToken> insert_batch(const vector<std::pair<unsigned, unsigned>>& batch, ThreadPool* pool);
+        void erase_batch(vector<EdgeToken>& tokens, ThreadPool* pool);
+        void reconnect(const vector<Cut>& cuts, ThreadPool* pool);
+        void reconnect(unsigned i, const vector<Cut>& cuts, ThreadPool* pool);
+        bool scan(unsigned i, unsigned local);
+        bool sample(unsigned i, unsigned local);
+        Probe probe(const Cut& cut);
+        void replace(unsigned id, unsigned i);
+        void push_tree_edges(unsigned i, unsigned local);
+        Level& level(unsigned i);
+        unsigned touch(unsigned i, unsigned v);
+        unsigned find(unsigned i, unsigned v);
+        void index_pairs();
+        void small_insert(unsigned id);
+        void small_erase(unsigned id);
+        void check_density();
     public:
+        // up to this many vertices a graph starts without levels: the
+        // adjacency and the spanning forest are bit matrices and a cut
+        // searches the smaller tree a row at a time, the edge pool, pair
+        // index and component index being the same as above it. A vertex
+        // only gets its rows with its first edge, and a graph whose rows
+        // outweigh its edges once they start going moves onto the levels
+        static const unsigned SMALL_LIMIT = 4096;
+
         explicit DynamicGraph(unsigned n);
+        // the edges are joined by labels alone and the top forest is then
+        // laid out in one pass; tokens gets one per edge, in order
+        DynamicGraph(unsigned n, const vector<std::pair<unsigned, unsigned>>& edges, vector<EdgeToken>& tokens);
         DynamicGraph(const DynamicGraph&) = delete;
         DynamicGraph&operator=(const DynamicGraph&) = delete;
-        ~DynamicGraph();
-
+        ~DynamicGraph() = default;
+
+        // ids of removed vertices are handed out again first; an added
+        // vertex past the reserved capacity reallocates the component
+        // index, so only then it must not race with readers
+        unsigned add_vertex();
+        // the edges of v go as one batch and v leaves the graph
+        void remove_vertex(unsigned v);
+        void reserve_vertices(unsigned capacity);
+        // moves a small graph onto the levels, as growing past SMALL_LIMIT
+        // vertices or thinning out does; there is no way back
+        void use_levels();
+        bool on_levels() const;
         EdgeToken add(unsigned v, unsigned u);
         void remove(EdgeToken&&);
-        bool is_connected(unsigned v, unsigned u);
-        bool is_connected();
+        vector<EdgeToken> add_batch(const vector<std::pair<unsigned, unsigned>>& edges);
+        // the pool runs what only reads the forests: the tree names of the
+        // endpoints and of the cut ends on every level, and the walks over
+        // the trees that get new labels. The updates are applied in batch
+        // order, so the graph ends up as with the plain overloads
+        vector<EdgeToken> add_batch(const vector<std::pair<unsigned, unsigned>>& edges, ThreadPool& pool);
+        void remove_batch(vector<EdgeToken>& tokens);
+        void remove_batch(vector<EdgeToken>& tokens, ThreadPool& pool);
+        bool contains(const EdgeToken&);
+        // by vertex pair, through an index of the pool built on first use
+        // and kept along from then on; remove takes the latest edge added
+        // between v and u and is false if there is none
+        bool remove(unsigned v, unsigned u);
+        bool has_edge(unsigned v, unsigned u);
+        unsigned multiplicity(unsigned v, unsigned u);
+        // random non-tree edges tried before each full replacement search
+        void set_sampling(unsigned samples);
+        // edges a deletion may look at around its ends before the full
+        // search, 0 to skip the local search
+        void set_probe_budget(unsigned budget);
+        const ProbeStats& probe_stats() const;
+        // until the next removal, edges only go through the component index,
+        // which keeps a spanning forest as a union-find would; the removal
+        // then hands them over to the levels, building the top forest in
+        // one go if it had no tree edges yet
+        void insert_only();
+        // every update from here on is written to the log as well, nullptr
+        // to stop; the log does this itself when opened on the graph
+        void set_log(UpdateLog* log);
+        // the queries below read the component index only and may run on
+        // any number of threads alongside the one applying updates
+        bool is_connected(unsigned v, unsigned u) const;
+        bool is_connected() const;
+        vector<unsigned char> is_connected(const vector<std::pair<unsigned, unsigned>>& pairs) const;
+        // the label of the component of v, valid until the next update
+        unsigned component(unsigned v) const;
+        unsigned degree(unsigned v) const;
+        unsigned component_size(unsigned v) const;
+        // applies the steps of a trace as they come, the answers of its
+        // queries in order
+        vector<unsigned char> replay(const vector<TraceStep>& trace);
         std::string str();
-        unsigned degree(unsigned v);
-        unsigned component_size(unsigned v);
+        // a versioned binary dump of the whole state, levels, edge levels
+        // and the sampling generator included, so a loaded graph goes on
+        // exactly as the saved one would; load must not race with readers
+        void save(const std::string& path) const;
+        void load(const std::string& path);
     };
 
-    class List {
-        Edge* edge;
-        unsigned u;
-        List* next;
-        List* prev;
-        List(unsigned, Edge*, List*, List*);
-    public:
-        List();
-
-        List* add(unsigned , Edge*);
-        ListIterator iterator();
-        unsigned vertex();
-        Edge* e();
-        ~List();
-
-        friend class Edge;
-        friend class ListIterator;
-    };
-
-    class ListIterator {
-        List* list;
-    public:
-        explicit ListIterator(List*);
-        ListIterator operator++(int);
-        List* operator*();
-        bool hasNext();
-    };
 }
 
 #endif //DGRAPH_DYNAMICGRAPH_H
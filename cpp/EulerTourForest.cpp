@@ -1,259 +1,357 @@
 #include "EulerTourForest.h"
+#include "Snapshot.h"
+#include <cstddef>
 #include <utility>
-#include <list>
 
 namespace dgraph {
 
-    void Entry::splay() {
-        while (parent != nullptr) {
-            Entry* grandpa = parent->parent;
-            bool is_left = parent->left == this;
-            if (grandpa != nullptr) {
-                bool p_is_left = grandpa->left == parent;
+    unsigned EulerTourForest::create(unsigned v) {
+        unsigned e = free_list;
+        if (e != NIL) {
+            free_list = links[e].parent;
+            links[e] = {NIL, NIL, NIL};
+            aggs[e] = {v, 1, 0, 0, 0, 0};
+        } else {
+            e = static_cast<unsigned>(links.size());
+            links.push_back({NIL, NIL, NIL});
+            aggs.push_back({v, 1, 0, 0, 0, 0});
+        }
+        return e;
+    }
+
+    void EulerTourForest::destroy(unsigned e) {
+        links[e].parent = free_list;
+        free_list = e;
+    }
+
+    void EulerTourForest::splay(unsigned e) {
+        while (links[e].parent != NIL) {
+            unsigned parent = links[e].parent;
+            unsigned grandpa = links[parent].parent;
+            bool is_left = links[parent].left == e;
+            if (grandpa != NIL) {
+                bool p_is_left = links[grandpa].left == parent;
                 if (is_left == p_is_left) {
-                    grandpa->rotate(p_is_left);
-                    parent->rotate(is_left);
+                    rotate(grandpa, p_is_left);
+                    rotate(parent, is_left);
                 } else {
-                    parent->rotate(is_left);
-                    grandpa->rotate(p_is_left);
+                    rotate(parent, is_left);
+                    rotate(grandpa, p_is_left);
                 }
             } else {
-                parent->rotate(is_left);
+                rotate(parent, is_left);
             }
         }
     }
 
-    void Entry::remove() {
-        splay();
-        if (left != nullptr) {
-            left->parent = nullptr;
+    void EulerTourForest::remove(unsigned e) {
+        splay(e);
+        unsigned left = links[e].left;
+        unsigned right = links[e].right;
+        if (left != NIL) {
+            links[left].parent = NIL;
         }
-        if (right != nullptr) {
-            right->parent = nullptr;
+        if (right != NIL) {
+            links[right].parent = NIL;
         }
-        if (left == nullptr || right == nullptr){
+        if (left == NIL || right == NIL){
             return;
         }
         merge(left, right);
     }
 
-    void Entry::rotate(bool left_rotate){
-        Entry* child = nullptr;
+    void EulerTourForest::rotate(unsigned e, bool left_rotate){
+        Links& node = links[e];
+        unsigned child;
         if(left_rotate) {
-            child = left;
-            left = child->right;
-            if (left != nullptr) {
-                left->parent = this;
+            child = node.left;
+            node.left = links[child].right;
+            if (node.left != NIL) {
+                links[node.left].parent = e;
             }
-            child->right = this;
+            links[child].right = e;
         } else {
-            child = right;
-            right = child->left;
-            if (right != nullptr) {
-                right->parent = this;
+            child = node.right;
+            node.right = links[child].left;
+            if (node.right != NIL) {
+                links[node.right].parent = e;
             }
-            child->left = this;
+            links[child].left = e;
         }
-        if (parent != nullptr) {
-            if (this == parent->left){
-                parent->left = child;
+        unsigned parent = node.parent;
+        if (parent != NIL) {
+            if (e == links[parent].left){
+                links[parent].left = child;
             } else {
-                parent->right = child;
+                links[parent].right = child;
             }
         }
-        child->parent = parent;
-        parent = child;
-        recalc();
-        child->recalc();
-        if (parent != nullptr){
-            parent->recalc();
-        }
+        links[child].parent = parent;
+        node.parent = child;
+        // the parent keeps the same subtree, only e and child change
+        recalc(e);
+        recalc(child);
     }
 
-    Entry* merge(Entry* l, Entry* r) {
-        if (l == nullptr) {
+    unsigned EulerTourForest::merge(unsigned l, unsigned r) {
+        if (l == NIL) {
             return r;
         }
-        if (r == nullptr) {
+        if (r == NIL) {
             return l;
         }
         r = find_root(r);
-        l = find_root(l)->rightmost();
+        l = rightmost(find_root(l));
 
-        l->splay();
-        l->right = r;
-        r->parent = l;
-        l->recalc();
+        splay(l);
+        links[l].right = r;
+        links[r].parent = l;
+        recalc(l);
         return l;
     }
 
-    Entry* find_root(Entry* e) {
-        while (e->parent != nullptr) e = e->parent;
+    unsigned EulerTourForest::find_root(unsigned e) const {
+        while (links[e].parent != NIL) e = links[e].parent;
         return e;
     }
 
-    Entry::Entry(unsigned v, Entry* l, Entry* r, Entry* p) : left(l), right(r), parent(p), v(v),
-                                                             size(1), edges(0), good(false) {}
-
-    Entry* Entry::succ() {
-        Entry* curr = this;
-        if(right == nullptr){
-            while (curr->parent != nullptr && curr == curr->parent->right) curr = curr->parent;
-            if (curr->parent == nullptr){
-                return nullptr;
-            }
-            return curr->parent;
+    unsigned EulerTourForest::succ(unsigned e) const {
+        unsigned curr = e;
+        if(links[e].right == NIL){
+            while (links[curr].parent != NIL && curr == links[links[curr].parent].right) curr = links[curr].parent;
+            return links[curr].parent;
         }
-        curr = right;
-        curr = curr->leftmost();
-        return curr;
+        return leftmost(links[e].right);
     }
 
-    std::pair<Entry*, Entry*> split(Entry* e, bool keep_in_left) {
-        e->splay();
-        Entry* left;
-        Entry* right;
+    std::pair<unsigned, unsigned> EulerTourForest::split(unsigned e, bool keep_in_left) {
+        splay(e);
+        unsigned left;
+        unsigned right;
         if (keep_in_left) {
             left = e;
-            right = e->right;
-            e->right = nullptr;
-            left->recalc();
-            if (right != nullptr) {
-                right->recalc();
-                right->parent = nullptr;
+            right = links[e].right;
+            links[e].right = NIL;
+            recalc(left);
+            if (right != NIL) {
+                recalc(right);
+                links[right].parent = NIL;
             }
         } else {
-            left = e->left;
+            left = links[e].left;
             right = e;
-            e->left = nullptr;
-            right->recalc();
-            if (left != nullptr) {
-                left->recalc();
-                left->parent = nullptr;
+            links[e].left = NIL;
+            recalc(right);
+            if (left != NIL) {
+                recalc(left);
+                links[left].parent = NIL;
             }
         }
         return std::make_pair(left, right);
     }
 
-    void Entry::recalc() {
-        size = 1;
-        good = edges > 0;
-        if(right != nullptr){
-            size += right->size;
-            good |= right->good;
+    void EulerTourForest::recalc(unsigned e) {
+        const Links& node = links[e];
+        Aggregate& agg = aggs[e];
+        agg.size = 1;
+        agg.sub_tree = agg.tree;
+        agg.sub_nontree = agg.nontree;
+        if(node.right != NIL){
+            const Aggregate& right = aggs[node.right];
+            agg.size += right.size;
+            agg.sub_tree += right.sub_tree;
+            agg.sub_nontree += right.sub_nontree;
         }
-        if(left != nullptr){
-            size += left->size;
-            good |= left->good;
+        if(node.left != NIL){
+            const Aggregate& left = aggs[node.left];
+            agg.size += left.size;
+            agg.sub_tree += left.sub_tree;
+            agg.sub_nontree += left.sub_nontree;
         }
     }
 
-    EulerTourForest::EulerTourForest(unsigned n) : n(n), any_root(nullptr) {
+    EulerTourForest::EulerTourForest(unsigned n) : n(n), free_list(NIL), any_root(NIL) {
+        links.reserve(n);
+        aggs.reserve(n);
         for (unsigned i = 0; i < n; i++) {
-            auto* vertex = new Entry(i);
-            any.push_back(vertex);
+            any.push_back(create(i));
         }
     }
 
-    EulerTourForest::EulerTourForest(EulerTourForest&& forest) noexcept :n(forest.n), any(std::move(forest.any)),
+    EulerTourForest::EulerTourForest(EulerTourForest&& forest) noexcept :n(forest.n), links(std::move(forest.links)),
+                                                                         aggs(std::move(forest.aggs)),
+                                                                         any(std::move(forest.any)),
+                                                                         free_list(forest.free_list),
                                                                          any_root(forest.any_root) {
         forest.n = 0;
     }
 
-    EulerTourForest::~EulerTourForest() {
-        std::vector<bool> vis(n, false);
-        std::list<Entry*> entries;
-        for (unsigned i = 0; i < n; i++) {
-            if (vis[i]) {
-                continue;
-            }
-            vis[i] = true;
-            Entry* e = find_root(any[i])->leftmost();
-            while (e != nullptr){
-                vis[e->v] = true;
-                entries.push_back(e);
-                e = e->succ();
-            }
-        }
-        for (Entry* e : entries) {
-            delete e;
-        }
+    unsigned EulerTourForest::add_vertex() {
+        any.push_back(create(n));
+        return n++;
     }
 
-    Entry* EulerTourForest::make_root(unsigned v) {
-        Entry* e = any[v];
+    unsigned EulerTourForest::vertices() {
+        return n;
+    }
+
+    unsigned EulerTourForest::make_root(unsigned v) {
+        unsigned e = any[v];
         auto cut = split(e, false);
         return merge(cut.second, cut.first);
     }
 
-    Entry* EulerTourForest::expand(unsigned v) {
-        Entry* e = make_root(v);
-        if (e->size == 1){
+    unsigned EulerTourForest::expand(unsigned v) {
+        unsigned e = make_root(v);
+        if (aggs[e].size == 1){
             return e;
         }
-        auto new_node = new Entry(v);
+        unsigned new_node = create(v);
         merge(e, new_node);
         return new_node;
     }
 
     TreeEdge EulerTourForest::link(unsigned v, unsigned u) {
-        Entry* l = expand(v);
-        Entry* r = expand(u);
+        unsigned l = expand(v);
+        unsigned r = expand(u);
         any_root = merge(l, r);
         return {l, r};
     }
 
-    void EulerTourForest::cut(Entry* first, Entry* last) {
-        any_root = nullptr;
+    // lays out the tours of a whole forest at once over vertices that are
+    // still singletons, each one as a balanced splay tree; the edges must
+    // not close a cycle. An edge gets the occurrences link would give it:
+    // the parent's one right before the child's subtree and the child's
+    // last one inside it. Every vertex but the root closes its subtree with
+    // one more occurrence of its own, the root does not, so a tree of k
+    // vertices has 2(k - 1) nodes as a linked one does
+    std::vector<TreeEdge> EulerTourForest::build(const std::vector<std::pair<unsigned, unsigned>>& edges) {
+        std::vector<TreeEdge> result(edges.size());
+        std::vector<unsigned> offset(n + 1, 0);
+        for (const auto& e : edges) {
+            offset[e.first + 1]++;
+            offset[e.second + 1]++;
+        }
+        for (unsigned v = 0; v < n; v++) {
+            offset[v + 1] += offset[v];
+        }
+        std::vector<unsigned> incident(2 * edges.size());
+        std::vector<unsigned> cursor(offset.begin(), offset.end() - 1);
+        for (unsigned k = 0; k < edges.size(); k++) {
+            incident[cursor[edges[k].first]++] = k;
+            incident[cursor[edges[k].second]++] = k;
+        }
+
+        struct Frame {
+            unsigned v;
+            unsigned next;
+            unsigned edge;
+        };
+        std::vector<bool> visited(n, false);
+        std::vector<Frame> stack;
+        std::vector<unsigned> tour;
+        for (unsigned root = 0; root < n; root++) {
+            if (visited[root] || offset[root] == offset[root + 1]) {
+                continue;
+            }
+            visited[root] = true;
+            tour.clear();
+            tour.push_back(any[root]);
+            stack.push_back({root, offset[root], NIL});
+            while (!stack.empty()) {
+                Frame& top = stack.back();
+                if (top.next < offset[top.v + 1]) {
+                    unsigned k = incident[top.next++];
+                    unsigned child = edges[k].first == top.v ? edges[k].second : edges[k].first;
+                    if (visited[child]) {
+                        continue;
+                    }
+                    visited[child] = true;
+                    result[k].edge = tour.back();
+                    tour.push_back(any[child]);
+                    stack.push_back({child, offset[child], k});
+                } else {
+                    unsigned edge = top.edge;
+                    stack.pop_back();
+                    if (edge != NIL) {
+                        result[edge].twin = tour.back();
+                        tour.push_back(create(stack.back().v));
+                    }
+                }
+            }
+            destroy(tour.back());
+            tour.pop_back();
+            any_root = assemble(tour, 0, static_cast<unsigned>(tour.size()));
+        }
+        return result;
+    }
+
+    unsigned EulerTourForest::assemble(const std::vector<unsigned>& tour, unsigned begin, unsigned end) {
+        if (begin == end) {
+            return NIL;
+        }
+        unsigned mid = begin + (end - begin) / 2;
+        unsigned e = tour[mid];
+        unsigned left = assemble(tour, begin, mid);
+        unsigned right = assemble(tour, mid + 1, end);
+        links[e] = {left, right, NIL};
+        if (left != NIL) {
+            links[left].parent = e;
+        }
+        if (right != NIL) {
+            links[right].parent = e;
+        }
+        recalc(e);
+        return e;
+    }
+
+    void EulerTourForest::cut(unsigned first, unsigned last) {
+        any_root = NIL;
         auto first_cut = split(first, true);
-        bool right_ordered = first_cut.second != nullptr && find_root(first_cut.second) == find_root(last);
+        bool right_ordered = first_cut.second != NIL && find_root(first_cut.second) == find_root(last);
         auto second_cut = split(last, true);
         if (!right_ordered) {
             std::swap(first_cut, second_cut);
         }
-        Entry* to_remove = first_cut.first->rightmost();
-        if (to_remove->is_singleton()) {
-            if (second_cut.second != nullptr) {
-                change_any(second_cut.second->leftmost());
-                delete to_remove;
+        unsigned to_remove = rightmost(first_cut.first);
+        if (is_singleton(to_remove)) {
+            if (second_cut.second != NIL) {
+                change_any(leftmost(second_cut.second));
+                destroy(to_remove);
             }
         } else {
             merge(to_remove, second_cut.second);
-            Entry* next = to_remove->succ();
-            if (next == nullptr) {
-                cutoff(to_remove);
-            } else {
-                cutoff(to_remove, next);
-            }
+            cutoff(to_remove, succ(to_remove));
         }
-        cutoff(second_cut.first->rightmost());
+        cutoff(rightmost(second_cut.first));
     }
 
-    void EulerTourForest::cutoff(Entry* e, Entry* replacement) {
-        if (e->is_singleton()) {
+    void EulerTourForest::cutoff(unsigned e, unsigned replacement) {
+        if (is_singleton(e)) {
             return;
         }
-        if (any[e->v] == e){
-            if (replacement == nullptr) {
-                change_any(find_root(e)->leftmost());
+        if (any[aggs[e].v] == e){
+            if (replacement == NIL) {
+                change_any(leftmost(find_root(e)));
             } else {
                 change_any(replacement);
             }
         }
-        e->remove();
-        delete e;
+        remove(e);
+        destroy(e);
     }
 
-    void EulerTourForest::change_any(Entry* e) {
-        unsigned edges = any[e->v]->edges;
-        unsigned v = e->v;
-        change_edges(v, 0);
+    void EulerTourForest::change_any(unsigned e) {
+        unsigned v = aggs[e].v;
+        int tree = static_cast<int>(aggs[any[v]].tree);
+        int nontree = static_cast<int>(aggs[any[v]].nontree);
+        add_edges(v, -tree, -nontree);
         any[v] = e;
-        change_edges(v, edges);
+        add_edges(v, tree, nontree);
     }
 
     bool EulerTourForest::is_connected() {
-        return any_root != nullptr && any_root->size == 2 * (n - 1);
+        return any_root != NIL && aggs[find_root(any_root)].size == 2 * (n - 1);
     }
 
     bool EulerTourForest::is_connected(unsigned v, unsigned u) {
@@ -263,81 +361,168 @@ namespace dgraph {
         return find_root(any[v]) == find_root(any[u]);
     }
 
-    void EulerTourForest::increment_edges(unsigned v) {
-        Entry* curr = any[v];
-        ++curr->edges;
-        if (curr->edges == 1) {
-            curr->good = true;
-            repair_edges_number(curr->parent);
-        }
+    void EulerTourForest::add_edges(unsigned v, int tree, int nontree) {
+        unsigned e = any[v];
+        splay(e);
+        Aggregate& agg = aggs[e];
+        agg.tree += tree;
+        agg.nontree += nontree;
+        agg.sub_tree += tree;
+        agg.sub_nontree += nontree;
+    }
+
+    // names the tree of v without restructuring it; the name is only valid
+    // until the forest is changed, splays included
+    unsigned EulerTourForest::tree_id(unsigned v) const {
+        return find_root(any[v]);
     }
 
-    void EulerTourForest::decrement_edges(unsigned v) {
-        Entry* curr = any[v];
-        --curr->edges;
-        if (curr->edges == 0) {
-            repair_edges_number(curr);
+    // appends every vertex of the tree of v once, walking the tour in order
+    void EulerTourForest::tree_vertices(unsigned v, std::vector<unsigned>& out) const {
+        for (unsigned e = leftmost(find_root(any[v])); e != NIL; e = succ(e)) {
+            if (any[aggs[e].v] == e) {
+                out.push_back(aggs[e].v);
+            }
         }
     }
 
-    void EulerTourForest::change_edges(unsigned v, unsigned n) {
-        Entry* curr = any[v];
-        curr->edges = n;
-        repair_edges_number(curr);
+    void EulerTourForest::increment_edges(unsigned v, unsigned count) {
+        add_edges(v, 0, static_cast<int>(count));
     }
 
-    void EulerTourForest::repair_edges_number(Entry* curr){
-        while (curr != nullptr) {
-            bool good = curr->edges > 0;
-            if (curr->left != nullptr) {
-                good |= curr->left->good;
-            }
-            if (curr->right != nullptr) {
-                good |= curr->right->good;
+    void EulerTourForest::decrement_edges(unsigned v, unsigned count) {
+        add_edges(v, 0, -static_cast<int>(count));
+    }
+
+    void EulerTourForest::increment_tree_edges(unsigned v, unsigned count) {
+        add_edges(v, static_cast<int>(count), 0);
+    }
+
+    void EulerTourForest::decrement_tree_edges(unsigned v, unsigned count) {
+        add_edges(v, -static_cast<int>(count), 0);
+    }
+
+    unsigned EulerTourForest::find_vertex(unsigned v, bool tree) {
+        unsigned e = any[v];
+        splay(e);
+        if ((tree ? aggs[e].sub_tree : aggs[e].sub_nontree) == 0) {
+            return NIL;
+        }
+        while (true) {
+            const Aggregate& agg = aggs[e];
+            if ((tree ? agg.tree : agg.nontree) > 0) {
+                break;
             }
-            if (good != curr->good) {
-                curr->good = good;
-                curr = curr->parent;
+            unsigned left = links[e].left;
+            if (left != NIL && (tree ? aggs[left].sub_tree : aggs[left].sub_nontree) > 0) {
+                e = left;
             } else {
-                return;
+                e = links[e].right;
             }
         }
+        splay(e);
+        return aggs[e].v;
     }
 
-    unsigned EulerTourForest::size(unsigned v) {
-        return find_root(any[v])->size;
+    unsigned EulerTourForest::find_tree_vertex(unsigned v) {
+        return find_vertex(v, true);
     }
 
-    Iterator EulerTourForest::iterator(unsigned v){
-        return any[v]->iterator();
+    unsigned EulerTourForest::find_nontree_vertex(unsigned v) {
+        return find_vertex(v, false);
+    }
+
+    // non-tree edge ends over the tree of v
+    unsigned EulerTourForest::nontree_edges(unsigned v) {
+        splay(any[v]);
+        return aggs[any[v]].sub_nontree;
+    }
+
+    // the vertex holding the rank-th non-tree edge end of the tree of v in
+    // tour order; rank is left as the position among the ends of that vertex
+    unsigned EulerTourForest::nth_nontree_vertex(unsigned v, unsigned& rank) {
+        unsigned e = any[v];
+        splay(e);
+        if (rank >= aggs[e].sub_nontree) {
+            return NIL;
+        }
+        while (true) {
+            unsigned left = links[e].left;
+            unsigned before = left == NIL ? 0 : aggs[left].sub_nontree;
+            if (rank < before) {
+                e = left;
+                continue;
+            }
+            rank -= before;
+            if (rank < aggs[e].nontree) {
+                break;
+            }
+            rank -= aggs[e].nontree;
+            e = links[e].right;
+        }
+        splay(e);
+        return aggs[e].v;
+    }
+
+    unsigned EulerTourForest::size(unsigned v) {
+        splay(any[v]);
+        return aggs[any[v]].size;
     }
 
     std::string EulerTourForest::str() {
-        std::string str;
+        std::string res;
         std::vector<bool> vis(n, false);
         for (unsigned i = 0; i < n; i++) {
-            Entry* curr = find_root(any[i]);
-            if(!vis[curr->vertex()]){
-                vis[curr->vertex()] = true;
-                str += curr->str() + "\n";
+            unsigned curr = find_root(any[i]);
+            if(!vis[aggs[curr].v]){
+                vis[aggs[curr].v] = true;
+                res += str(curr) + "\n";
             }
         }
-        str += "edges: \n";
+        res += "edges: \n";
         for (unsigned i = 0; i < n; i++) {
-            str += std::to_string(any[i]->edges) + " ";
+            res += std::to_string(aggs[any[i]].tree) + "/" + std::to_string(aggs[any[i]].nontree) + " ";
+        }
+        res += "\n";
+        return res;
+    }
+
+    std::string EulerTourForest::str(unsigned e) const {
+        std::string str;
+        e = leftmost(e);
+        while(e != NIL){
+            str += std::to_string(aggs[e].v);
+            e = succ(e);
         }
-        str += "\n";
         return str;
     }
 
+    void EulerTourForest::save(std::ostream& out) const {
+        snapshot::write(out, n);
+        snapshot::write(out, free_list);
+        snapshot::write(out, any_root);
+        snapshot::write_array(out, links);
+        snapshot::write_array(out, aggs);
+        snapshot::write_array(out, any);
+    }
+
+    void EulerTourForest::load(std::istream& in) {
+        snapshot::read(in, n);
+        snapshot::read(in, free_list);
+        snapshot::read(in, any_root);
+        snapshot::read_array(in, links);
+        snapshot::read_array(in, aggs);
+        snapshot::read_array(in, any);
+    }
+
     void EulerTourForest::cut(TreeEdge&& edge) {
-        if (edge.edge != nullptr) {
+        if (edge.edge != NIL) {
             cut(edge.edge, edge.twin);
         }
     }
 
     unsigned EulerTourForest::degree(unsigned v) {
-        return any[v]->edges;
+        return aggs[any[v]].tree + aggs[any[v]].nontree;
     }
 
     unsigned EulerTourForest::component_size(unsigned v) {
@@ -348,92 +533,60 @@ namespace dgraph {
         return nodes / 2 + 1;
     }
 
-    Iterator::Iterator(Entry* entry) :entry(entry){}
-
-    Iterator& Iterator::operator++() {
-        if (entry->right != nullptr && entry->right->good){
-            entry = entry->right;
-            while (true){
-                if (entry->left != nullptr && entry->left->good){
-                    entry = entry->left;
-                    continue;
-                }
-                if(entry->edges > 0){
-                    return *this;
-                }
-                entry = entry->right;
-            }
-        }
-        while (true) {
-            if (entry->parent == nullptr) {
-                entry = nullptr;
-                return *this;
-            }
-            if (entry->parent->right != nullptr && entry->parent->right == entry){
-                entry = entry->parent;
-                continue;
-            } else {
-                entry = entry->parent;
-                break;
-            }
-        }
-        if (entry->edges > 0){
-            return *this;
-        }
-        return ++(*this);
-    }
-
-    unsigned Iterator::operator*() {
-        return entry->v;
-    }
-
-    bool Iterator::hasNext() {
-        return entry != nullptr;
+    unsigned EulerTourForest::leftmost(unsigned e) const {
+        while (links[e].left != NIL) e = links[e].left;
+        return e;
     }
 
-    Iterator Entry::iterator() {
-        Entry* curr = find_root(this)->leftmost();
-        Iterator iterator(curr);
-        if(!curr->good) {
-            ++iterator;
-        }
-        return iterator;
+    unsigned EulerTourForest::rightmost(unsigned e) const {
+        while (links[e].right != NIL) e = links[e].right;
+        return e;
     }
 
-    unsigned Entry::vertex() {
-        return v;
+    bool EulerTourForest::is_singleton(unsigned e) const {
+        const Links& node = links[e];
+        return node.parent == NIL && node.left == NIL && node.right == NIL;
     }
 
-    std::string Entry::str() {
-        std::string str;
-        Entry* e = leftmost();
-        while(e != nullptr){
-            str += std::to_string(e->v);
-            e = e->succ();
-        }
-        return str;
-    }
+    TreeEdge::TreeEdge(unsigned e, unsigned t) :edge(e), twin(t) {}
 
-    Entry* Entry::leftmost() {
-        Entry* curr = this;
-        while (curr->left != nullptr) curr = curr->left;
-        return curr;
-    }
+    TreeEdge::TreeEdge() :edge(NIL), twin(NIL) {}
 
-    Entry* Entry::rightmost() {
-        Entry* curr = this;
-        while (curr->right != nullptr) curr = curr->right;
-        return curr;
+    TreeEdge::TreeEdge(TreeEdge&& edge) noexcept :edge(edge.edge), twin(edge.twin){
+        edge.twin = NIL;
+        edge.edge = NIL;
     }
 
-    bool Entry::is_singleton() {
-        return parent == nullptr && left == nullptr && right == nullptr;
+    TreeEdge& TreeEdge::operator=(TreeEdge&& edge) noexcept {
+        std::swap(this->edge, edge.edge);
+        std::swap(twin, edge.twin);
+        return *this;
     }
 
-    TreeEdge::TreeEdge(Entry* e, Entry* t) :edge(e), twin(t) {}
+    namespace snapshot {
+        template <>
+        void write_array(std::ostream& out, const std::vector<TreeEdge>& values) {
+            std::vector<unsigned> plain;
+            plain.reserve(2 * values.size());
+            for (const TreeEdge& e : values) {
+                plain.push_back(e.edge);
+                plain.push_back(e.twin);
+            }
+            write_array(out, plain);
+        }
 
-    TreeEdge::TreeEdge(TreeEdge&& edge) noexcept :edge(edge.edge), twin(edge.twin){
-        edge.twin = nullptr;
-        edge.edge = nullptr;
+        template <>
+        void read_array(std::istream& in, std::vector<TreeEdge>& values) {
+            std::vector<unsigned> plain;
+            read_array(in, plain);
+            if (plain.size() % 2 != 0) {
+                throw std::runtime_error("corrupt snapshot");
+            }
+            values.clear();
+            values.reserve(plain.size() / 2);
+            for (std::size_t k = 0; k < plain.size(); k += 2) {
+                values.push_back(TreeEdge(plain[k], plain[k + 1]));
+            }
+        }
     }
 }
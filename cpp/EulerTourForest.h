@@ -1,95 +1,122 @@
 #ifndef DGRAPH_EULERTOURTREE_H
 #define DGRAPH_EULERTOURTREE_H
 
+#include "Snapshot.h"
+
+#include <istream>
+#include <ostream>
 #include <vector>
 #include <string>
 
 namespace dgraph {
-    class Iterator;
     class EulerTourForest;
 
-    class Entry {
-        Entry* left;
-        Entry* right;
-        Entry* parent;
-        unsigned v;
-        unsigned size;
-        unsigned edges;
-        bool good;
-
-        explicit Entry(unsigned , Entry* = nullptr, Entry* = nullptr, Entry* = nullptr);
-
-        void splay();
-        void rotate(bool);
-        void remove();
-        Entry* succ();
-        Entry* leftmost();
-        Entry* rightmost();
-        void recalc();
-        Iterator iterator();
-        bool is_singleton();
-        std::string str();
-        unsigned depth(unsigned);
-
-        friend Entry* merge(Entry*, Entry*);
-        friend std::pair<Entry*, Entry*> split(Entry*, bool);
-        friend Entry* find_root(Entry* e);
-
-        friend class EulerTourForest;
-        friend class Iterator;
+    // splay tree nodes are indices into the arrays of the owning forest,
+    // so a forest is a handful of flat vectors and can be copied as is
+    const unsigned NIL = ~0u;
 
-    public:
-        unsigned vertex();
+    struct Links {
+        unsigned left;
+        unsigned right;
+        unsigned parent;
     };
 
-    class Iterator {
-        Entry* entry;
-    public:
-        explicit Iterator(Entry*);
-        Iterator& operator++();
-        unsigned operator*();
-        bool hasNext();
+    // tree and nontree count the level's tree and non-tree edges incident
+    // to the vertex and are only set on its any occurrence; the sub_ fields
+    // sum them over the subtree
+    struct Aggregate {
+        unsigned v;
+        unsigned size;
+        unsigned tree;
+        unsigned nontree;
+        unsigned sub_tree;
+        unsigned sub_nontree;
     };
 
     class TreeEdge {
-        Entry* edge;
-        Entry* twin;
-        TreeEdge(Entry*, Entry*);
+        unsigned edge;
+        unsigned twin;
+        TreeEdge(unsigned, unsigned);
     public:
+        TreeEdge();
         TreeEdge(TreeEdge&&) noexcept;
+        TreeEdge& operator=(TreeEdge&&) noexcept;
         ~TreeEdge() = default;
 
         friend class EulerTourForest;
+        friend void snapshot::write_array<>(std::ostream&, const std::vector<TreeEdge>&);
+        friend void snapshot::read_array<>(std::istream&, std::vector<TreeEdge>&);
     };
 
+    namespace snapshot {
+        // a tree edge is written as its two occurrences
+        template <>
+        void write_array(std::ostream& out, const std::vector<TreeEdge>& values);
+        template <>
+        void read_array(std::istream& in, std::vector<TreeEdge>& values);
+    }
+
     class EulerTourForest {
-        int n;
-        std::vector<Entry*> any;
-        Entry* any_root;
-        Entry* make_root(unsigned v);
-        Entry* expand(unsigned v);
-        void change_any(Entry* e);
-        void cutoff(Entry* e, Entry* replacement = nullptr);
-        void cut(Entry*, Entry*);
-        void repair_edges_number(Entry*);
+        unsigned n;
+        std::vector<Links> links;
+        std::vector<Aggregate> aggs;
+        std::vector<unsigned> any;
+        unsigned free_list;
+        unsigned any_root;
+
+        unsigned create(unsigned v);
+        void destroy(unsigned e);
+        void splay(unsigned e);
+        void rotate(unsigned e, bool left_rotate);
+        void remove(unsigned e);
+        unsigned succ(unsigned e) const;
+        unsigned leftmost(unsigned e) const;
+        unsigned rightmost(unsigned e) const;
+        unsigned find_root(unsigned e) const;
+        void recalc(unsigned e);
+        bool is_singleton(unsigned e) const;
+        unsigned merge(unsigned l, unsigned r);
+        std::pair<unsigned, unsigned> split(unsigned e, bool keep_in_left);
+        std::string str(unsigned e) const;
+
+        unsigned make_root(unsigned v);
+        unsigned expand(unsigned v);
+        void change_any(unsigned e);
+        void cutoff(unsigned e, unsigned replacement = NIL);
+        void cut(unsigned, unsigned);
+        void add_edges(unsigned v, int tree, int nontree);
+        unsigned assemble(const std::vector<unsigned>& tour, unsigned begin, unsigned end);
+        unsigned find_vertex(unsigned v, bool tree);
 
     public:
-        explicit EulerTourForest(unsigned);
-        EulerTourForest(const EulerTourForest&) = delete;
-        EulerTourForest& operator=(const EulerTourForest&) = delete;
+        explicit EulerTourForest(unsigned = 0);
+        EulerTourForest(const EulerTourForest&) = default;
+        EulerTourForest& operator=(const EulerTourForest&) = default;
         EulerTourForest(EulerTourForest&&) noexcept;
-        ~EulerTourForest();
+        ~EulerTourForest() = default;
+
+        unsigned add_vertex();
+        unsigned vertices();
 
         bool is_connected(unsigned v, unsigned u);
         bool is_connected();
         TreeEdge link(unsigned v, unsigned u);
+        std::vector<TreeEdge> build(const std::vector<std::pair<unsigned, unsigned>>& edges);
         void cut(TreeEdge&&);
-        void increment_edges(unsigned v);
-        void decrement_edges(unsigned v);
-        void change_edges(unsigned v, unsigned n);
+        unsigned tree_id(unsigned v) const;
+        void tree_vertices(unsigned v, std::vector<unsigned>& out) const;
+        void increment_edges(unsigned v, unsigned count = 1);
+        void decrement_edges(unsigned v, unsigned count = 1);
+        void increment_tree_edges(unsigned v, unsigned count = 1);
+        void decrement_tree_edges(unsigned v, unsigned count = 1);
+        unsigned find_tree_vertex(unsigned v);
+        unsigned find_nontree_vertex(unsigned v);
+        unsigned nontree_edges(unsigned v);
+        unsigned nth_nontree_vertex(unsigned v, unsigned& rank);
         unsigned size(unsigned v);
-        Iterator iterator(unsigned v);
         std::string str();
+        void save(std::ostream& out) const;
+        void load(std::istream& in);
         unsigned degree(unsigned v);
         unsigned component_size(unsigned v);
     };
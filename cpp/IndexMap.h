@@ -0,0 +1,129 @@
+#ifndef DGRAPH_INDEXMAP_H
+#define DGRAPH_INDEXMAP_H
+
+#include "Snapshot.h"
+
+#include <vector>
+#include <utility>
+
+namespace dgraph {
+    // open addressing hash map from 32-bit ids with linear probing and
+    // backward shift deletion, kept at most half full
+    template <typename T>
+    class IndexMap {
+        static const unsigned NIL = ~0u;
+        std::vector<unsigned> keys;
+        std::vector<T> values;
+        unsigned count;
+        unsigned bits;
+
+        unsigned home(unsigned key) const {
+            return (key * 2654435769u) >> (32 - bits);
+        }
+
+        unsigned mask() const {
+            return static_cast<unsigned>(keys.size()) - 1;
+        }
+
+        unsigned locate(unsigned key) const {
+            if (count == 0) {
+                return NIL;
+            }
+            for (unsigned i = home(key); keys[i] != NIL; i = (i + 1) & mask()) {
+                if (keys[i] == key) {
+                    return i;
+                }
+            }
+            return NIL;
+        }
+
+        void grow() {
+            std::vector<unsigned> old_keys(std::move(keys));
+            std::vector<T> old_values(std::move(values));
+            bits = bits == 0 ? 4 : bits + 1;
+            keys.assign(1u << bits, NIL);
+            values.clear();
+            values.resize(1u << bits);
+            for (unsigned j = 0; j < old_keys.size(); j++) {
+                if (old_keys[j] != NIL) {
+                    unsigned i = home(old_keys[j]);
+                    while (keys[i] != NIL) i = (i + 1) & mask();
+                    keys[i] = old_keys[j];
+                    values[i] = std::move(old_values[j]);
+                }
+            }
+        }
+
+    public:
+        IndexMap() :count(0), bits(0) {}
+
+        T* find(unsigned key) {
+            unsigned i = locate(key);
+            return i == NIL ? nullptr : &values[i];
+        }
+
+        const T* find(unsigned key) const {
+            unsigned i = locate(key);
+            return i == NIL ? nullptr : &values[i];
+        }
+
+        void reserve(unsigned size) {
+            while (2 * size > keys.size()) {
+                grow();
+            }
+        }
+
+        void insert(unsigned key, T&& value) {
+            if (2 * (count + 1) > keys.size()) {
+                grow();
+            }
+            unsigned i = home(key);
+            while (keys[i] != NIL && keys[i] != key) i = (i + 1) & mask();
+            if (keys[i] == NIL) {
+                keys[i] = key;
+                count++;
+            }
+            values[i] = std::move(value);
+        }
+
+        T take(unsigned key) {
+            unsigned i = locate(key);
+            T value(std::move(values[i]));
+            for (unsigned j = (i + 1) & mask(); keys[j] != NIL; j = (j + 1) & mask()) {
+                unsigned k = home(keys[j]);
+                bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+                if (!stays) {
+                    keys[i] = keys[j];
+                    values[i] = std::move(values[j]);
+                    i = j;
+                }
+            }
+            keys[i] = NIL;
+            count--;
+            return value;
+        }
+
+        unsigned size() const {
+            return count;
+        }
+
+        void save(std::ostream& out) const {
+            snapshot::write(out, count);
+            snapshot::write(out, bits);
+            snapshot::write_array(out, keys);
+            snapshot::write_array(out, values);
+        }
+
+        void load(std::istream& in) {
+            snapshot::read(in, count);
+            snapshot::read(in, bits);
+            snapshot::read_array(in, keys);
+            snapshot::read_array(in, values);
+        }
+    };
+
+    template <typename T>
+    const unsigned IndexMap<T>::NIL;
+}
+
+#endif //DGRAPH_INDEXMAP_H
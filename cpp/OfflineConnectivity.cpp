@@ -0,0 +1,182 @@
+#include "OfflineConnectivity.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+
+namespace dgraph {
+    using std::vector;
+
+    OfflineConnectivity::RollbackSets::RollbackSets(unsigned n) :parent(n), size(n, 1) {
+        for (unsigned v = 0; v < n; v++) {
+            parent[v] = v;
+        }
+    }
+
+    unsigned OfflineConnectivity::RollbackSets::find(unsigned x) const {
+        while (parent[x] != x) {
+            x = parent[x];
+        }
+        return x;
+    }
+
+    void OfflineConnectivity::RollbackSets::unite(unsigned v, unsigned u) {
+        v = find(v);
+        u = find(u);
+        if (v == u) {
+            return;
+        }
+        if (size[v] > size[u]) {
+            std::swap(v, u);
+        }
+        parent[v] = u;
+        size[u] += size[v];
+        history.push_back(v);
+    }
+
+    unsigned OfflineConnectivity::RollbackSets::mark() const {
+        return static_cast<unsigned>(history.size());
+    }
+
+    void OfflineConnectivity::RollbackSets::rollback(unsigned mark) {
+        while (history.size() > mark) {
+            unsigned v = history.back();
+            history.pop_back();
+            size[parent[v]] -= size[v];
+            parent[v] = v;
+        }
+    }
+
+    OfflineConnectivity::OfflineConnectivity(unsigned n) :n(n), queries(0) {}
+
+    vector<unsigned char> OfflineConnectivity::run(const vector<TraceStep>& trace) {
+        return answer(trace, nullptr);
+    }
+
+    vector<unsigned char> OfflineConnectivity::run(const vector<TraceStep>& trace, ThreadPool& pool) {
+        return answer(trace, &pool);
+    }
+
+    void OfflineConnectivity::insert(unsigned node, unsigned lo, unsigned hi, unsigned from, unsigned to,
+                                     const Pair& edge) {
+        if (from <= lo && hi <= to) {
+            nodes[node].push_back(edge);
+            return;
+        }
+        unsigned mid = lo + (hi - lo) / 2;
+        if (from < mid) {
+            insert(2 * node, lo, mid, from, to, edge);
+        }
+        if (mid < to) {
+            insert(2 * node + 1, mid, hi, from, to, edge);
+        }
+    }
+
+    void OfflineConnectivity::walk(unsigned node, unsigned lo, unsigned hi, RollbackSets& sets,
+                                   vector<unsigned char>& answers) const {
+        unsigned mark = sets.mark();
+        for (const Pair& e : nodes[node]) {
+            sets.unite(e.first, e.second);
+        }
+        if (hi - lo == 1) {
+            answers[lo] = sets.find(asked[lo].first) == sets.find(asked[lo].second);
+        } else {
+            unsigned mid = lo + (hi - lo) / 2;
+            walk(2 * node, lo, mid, sets, answers);
+            walk(2 * node + 1, mid, hi, sets, answers);
+        }
+        sets.rollback(mark);
+    }
+
+    vector<unsigned char> OfflineConnectivity::answer(const vector<TraceStep>& trace, ThreadPool* pool) {
+        // the lifetime of an edge is the queries between its addition and
+        // the removal it is paired with; parallel edges of a pair are paired
+        // last in first out, which connectivity cannot tell from any other way
+        asked.clear();
+        vector<std::tuple<std::uint64_t, unsigned, bool>> events;
+        for (const TraceStep& step : trace) {
+            if (step.kind == TraceStep::Kind::query) {
+                asked.emplace_back(step.v, step.u);
+            } else if (step.v != step.u) {
+                std::uint64_t key = static_cast<std::uint64_t>(std::min(step.v, step.u)) << 32
+                                    | std::max(step.v, step.u);
+                events.emplace_back(key, static_cast<unsigned>(asked.size()), step.kind == TraceStep::Kind::add);
+            }
+        }
+        queries = static_cast<unsigned>(asked.size());
+        vector<unsigned char> answers(queries);
+        if (queries == 0) {
+            return answers;
+        }
+        nodes.assign(4 * queries, vector<Pair>());
+        std::stable_sort(events.begin(), events.end(), [](const std::tuple<std::uint64_t, unsigned, bool>& a,
+                                                          const std::tuple<std::uint64_t, unsigned, bool>& b) {
+            return std::get<0>(a) < std::get<0>(b);
+        });
+        vector<unsigned> open;
+        for (unsigned k = 0; k < events.size();) {
+            std::uint64_t key = std::get<0>(events[k]);
+            Pair edge(static_cast<unsigned>(key >> 32), static_cast<unsigned>(key));
+            open.clear();
+            for (; k < events.size() && std::get<0>(events[k]) == key; k++) {
+                unsigned time = std::get<1>(events[k]);
+                if (std::get<2>(events[k])) {
+                    open.push_back(time);
+                } else if (!open.empty()) {
+                    if (open.back() < time) {
+                        insert(1, 0, queries, open.back(), time, edge);
+                    }
+                    open.pop_back();
+                }
+            }
+            for (unsigned from : open) {
+                if (from < queries) {
+                    insert(1, 0, queries, from, queries, edge);
+                }
+            }
+        }
+
+        // the subtrees a few levels down are walked as separate tasks, each
+        // starting from the edges of the nodes above it
+        struct Task {
+            unsigned node;
+            unsigned lo;
+            unsigned hi;
+        };
+        vector<Task> tasks(1, Task{1, 0, queries});
+        unsigned wanted = pool == nullptr ? 1 : 4 * (pool->size() + 1);
+        while (tasks.size() < wanted) {
+            vector<Task> deeper;
+            for (const Task& task : tasks) {
+                if (task.hi - task.lo == 1) {
+                    deeper.push_back(task);
+                    continue;
+                }
+                unsigned mid = task.lo + (task.hi - task.lo) / 2;
+                deeper.push_back(Task{2 * task.node, task.lo, mid});
+                deeper.push_back(Task{2 * task.node + 1, mid, task.hi});
+            }
+            if (deeper.size() == tasks.size()) {
+                break;
+            }
+            tasks.swap(deeper);
+        }
+        auto body = [&](unsigned from, unsigned to) {
+            for (unsigned k = from; k < to; k++) {
+                RollbackSets sets(n);
+                for (unsigned node = tasks[k].node / 2; node > 0; node /= 2) {
+                    for (const Pair& e : nodes[node]) {
+                        sets.unite(e.first, e.second);
+                    }
+                }
+                walk(tasks[k].node, tasks[k].lo, tasks[k].hi, sets, answers);
+            }
+        };
+        if (pool == nullptr) {
+            body(0, static_cast<unsigned>(tasks.size()));
+        } else {
+            pool->parallel_for(0, static_cast<unsigned>(tasks.size()), body, 1);
+        }
+        return answers;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DGRAPH_OFFLINECONNECTIVITY_H
+#define DGRAPH_OFFLINECONNECTIVITY_H
+
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <utility>
+#include <vector>
+
+namespace dgraph {
+    // answers the queries of a trace known in full: every edge is alive
+    // over an interval of queries, the intervals go to the nodes of a
+    // segment tree over the queries and a depth-first walk of the tree
+    // unions them into a union-find that is rolled back on the way up,
+    // O(m log m log n) in all. Subtrees are walked independently, so with
+    // a pool each of them starts over from its ancestors' edges
+    class OfflineConnectivity {
+        typedef std::pair<unsigned, unsigned> Pair;
+
+        // union by size without path compression, so unions undo
+        class RollbackSets {
+            std::vector<unsigned> parent;
+            std::vector<unsigned> size;
+            std::vector<unsigned> history;
+        public:
+            explicit RollbackSets(unsigned n);
+            unsigned find(unsigned x) const;
+            void unite(unsigned v, unsigned u);
+            unsigned mark() const;
+            void rollback(unsigned mark);
+        };
+
+        unsigned n;
+        unsigned queries;
+        std::vector<std::vector<Pair>> nodes;
+        std::vector<Pair> asked;
+
+        void insert(unsigned node, unsigned lo, unsigned hi, unsigned from, unsigned to, const Pair& edge);
+        void walk(unsigned node, unsigned lo, unsigned hi, RollbackSets& sets, std::vector<unsigned char>& answers) const;
+        std::vector<unsigned char> answer(const std::vector<TraceStep>& trace, ThreadPool* pool);
+    public:
+        explicit OfflineConnectivity(unsigned n);
+
+        // one answer per query of the trace, in order
+        std::vector<unsigned char> run(const std::vector<TraceStep>& trace);
+        std::vector<unsigned char> run(const std::vector<TraceStep>& trace, ThreadPool& pool);
+    };
+}
+
+#endif //DGRAPH_OFFLINECONNECTIVITY_H
@@ -0,0 +1,111 @@
+#include "PairIndex.h"
+#include "DynamicGraph.h"
+
+#include <algorithm>
+
+namespace dgraph {
+    namespace {
+        std::uint64_t pair_key(unsigned v, unsigned u) {
+            return static_cast<std::uint64_t>(std::min(v, u)) << 32 | std::max(v, u);
+        }
+    }
+
+    const unsigned PairIndex::NIL;
+
+    PairIndex::PairIndex() :count(0), bits(0) {}
+
+    unsigned PairIndex::home(std::uint64_t key) const {
+        return static_cast<unsigned>((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+    }
+
+    unsigned PairIndex::mask() const {
+        return static_cast<unsigned>(slots.size()) - 1;
+    }
+
+    unsigned PairIndex::locate(const vector<Edge>& edges, std::uint64_t key) const {
+        if (count == 0) {
+            return NIL;
+        }
+        for (unsigned i = home(key); slots[i] != NIL; i = (i + 1) & mask()) {
+            const Edge& e = edges[slots[i]];
+            if (pair_key(e.v, e.u) == key) {
+                return i;
+            }
+        }
+        return NIL;
+    }
+
+    void PairIndex::grow(const vector<Edge>& edges) {
+        vector<unsigned> old(std::move(slots));
+        bits = bits == 0 ? 4 : bits + 1;
+        slots.assign(1u << bits, NIL);
+        for (unsigned id : old) {
+            if (id != NIL) {
+                unsigned i = home(pair_key(edges[id].v, edges[id].u));
+                while (slots[i] != NIL) i = (i + 1) & mask();
+                slots[i] = id;
+            }
+        }
+    }
+
+    void PairIndex::insert(const vector<Edge>& edges, unsigned id) {
+        if (parallel.size() < edges.size()) {
+            parallel.resize(edges.capacity(), NIL);
+        }
+        std::uint64_t key = pair_key(edges[id].v, edges[id].u);
+        unsigned i = locate(edges, key);
+        if (i != NIL) {
+            parallel[id] = slots[i];
+            slots[i] = id;
+            return;
+        }
+        if (2 * (count + 1) > slots.size()) {
+            grow(edges);
+        }
+        i = home(key);
+        while (slots[i] != NIL) i = (i + 1) & mask();
+        slots[i] = id;
+        parallel[id] = NIL;
+        count++;
+    }
+
+    void PairIndex::erase(const vector<Edge>& edges, unsigned id) {
+        unsigned i = locate(edges, pair_key(edges[id].v, edges[id].u));
+        if (slots[i] != id) {
+            unsigned w = slots[i];
+            while (parallel[w] != id) w = parallel[w];
+            parallel[w] = parallel[id];
+            return;
+        }
+        if (parallel[id] != NIL) {
+            slots[i] = parallel[id];
+            return;
+        }
+        for (unsigned j = (i + 1) & mask(); slots[j] != NIL; j = (j + 1) & mask()) {
+            unsigned k = home(pair_key(edges[slots[j]].v, edges[slots[j]].u));
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i] = NIL;
+        count--;
+    }
+
+    unsigned PairIndex::find(const vector<Edge>& edges, unsigned v, unsigned u) const {
+        unsigned i = locate(edges, pair_key(v, u));
+        return i == NIL ? NIL : slots[i];
+    }
+
+    unsigned PairIndex::next(unsigned id) const {
+        return parallel[id];
+    }
+
+    void PairIndex::clear() {
+        slots.clear();
+        parallel.clear();
+        count = 0;
+        bits = 0;
+    }
+}
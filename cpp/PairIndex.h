@@ -0,0 +1,41 @@
+#ifndef DGRAPH_PAIRINDEX_H
+#define DGRAPH_PAIRINDEX_H
+
+#include <cstdint>
+#include <vector>
+
+namespace dgraph {
+    class Edge;
+
+    // open addressing hash set of the vertex pairs of the edge pool with
+    // linear probing and backward shift deletion, kept at most half full.
+    // A slot is only the id of the latest edge of its pair, the pair itself
+    // is read from the pool; earlier parallel edges are chained behind it
+    // through an array indexed by edge id
+    class PairIndex {
+        static const unsigned NIL = ~0u;
+        std::vector<unsigned> slots;
+        std::vector<unsigned> parallel;
+        unsigned count;
+        unsigned bits;
+
+        unsigned home(std::uint64_t key) const;
+        unsigned mask() const;
+        unsigned locate(const std::vector<Edge>& edges, std::uint64_t key) const;
+        void grow(const std::vector<Edge>& edges);
+
+    public:
+        PairIndex();
+
+        // the edge must already be in the pool, and still be when erased
+        void insert(const std::vector<Edge>& edges, unsigned id);
+        void erase(const std::vector<Edge>& edges, unsigned id);
+        // the latest edge between v and u, NIL if there is none
+        unsigned find(const std::vector<Edge>& edges, unsigned v, unsigned u) const;
+        // the edge added between the same pair before id, NIL if none
+        unsigned next(unsigned id) const;
+        void clear();
+    };
+}
+
+#endif //DGRAPH_PAIRINDEX_H
@@ -0,0 +1,95 @@
+#ifndef DGRAPH_SNAPSHOT_H
+#define DGRAPH_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace dgraph {
+    // the binary snapshot is the index based arrays of the structures as
+    // they lie in memory: a value is its bytes, an array a 64-bit length
+    // and then its elements, so nothing needs fixing up on the way back.
+    // Only trivially copyable types are written as bytes; a type that is
+    // not, such as the move-only TreeEdge, specialises the array functions
+    namespace snapshot {
+        template <typename T>
+        void write(std::ostream& out, const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data goes to a snapshot");
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void read(std::istream& in, T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data comes from a snapshot");
+            in.read(reinterpret_cast<char*>(&value), sizeof(T));
+            if (!in) {
+                throw std::runtime_error("truncated snapshot");
+            }
+        }
+
+        template <typename T>
+        void write_array(std::ostream& out, const std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data goes to a snapshot");
+            write(out, static_cast<std::uint64_t>(values.size()));
+            out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+
+        template <typename T>
+        void read_array(std::istream& in, std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data comes from a snapshot");
+            std::uint64_t size;
+            read(in, size);
+            if (size > values.max_size()) {
+                throw std::runtime_error("corrupt snapshot");
+            }
+            // grown as the elements turn up, so a corrupt length runs into
+            // the end of the stream before it can claim the memory
+            const std::uint64_t chunk = (std::uint64_t(1) << 20) / sizeof(T) + 1;
+            values.clear();
+            while (values.size() < size) {
+                std::size_t from = values.size();
+                std::size_t step = static_cast<std::size_t>(std::min(chunk, size - from));
+                values.resize(from + step);
+                in.read(reinterpret_cast<char*>(values.data() + from), step * sizeof(T));
+                if (!in) {
+                    throw std::runtime_error("truncated snapshot");
+                }
+            }
+        }
+
+        // a vector of vectors is written flat, the offsets first
+        inline void write_nested(std::ostream& out, const std::vector<std::vector<unsigned>>& lists) {
+            std::vector<unsigned> offsets(1, 0);
+            std::vector<unsigned> flat;
+            for (const auto& list : lists) {
+                flat.insert(flat.end(), list.begin(), list.end());
+                offsets.push_back(static_cast<unsigned>(flat.size()));
+            }
+            write_array(out, offsets);
+            write_array(out, flat);
+        }
+
+        inline void read_nested(std::istream& in, std::vector<std::vector<unsigned>>& lists) {
+            std::vector<unsigned> offsets;
+            std::vector<unsigned> flat;
+            read_array(in, offsets);
+            read_array(in, flat);
+            if (offsets.empty() || offsets[0] != 0 || offsets.back() != flat.size()
+                || !std::is_sorted(offsets.begin(), offsets.end())) {
+                throw std::runtime_error("corrupt snapshot");
+            }
+            lists.clear();
+            lists.resize(offsets.size() - 1);
+            for (unsigned k = 0; k < lists.size(); k++) {
+                lists[k].assign(flat.begin() + offsets[k], flat.begin() + offsets[k + 1]);
+            }
+        }
+    }
+}
+
+#endif //DGRAPH_SNAPSHOT_H
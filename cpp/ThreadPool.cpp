@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace dgraph {
+
+    ThreadPool::ThreadPool(unsigned threads) :queued(0), stopping(false) {
+        for (unsigned i = 0; i < threads; i++) {
+            queues.emplace_back(new Queue());
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            this->threads.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    unsigned ThreadPool::size() const {
+        return static_cast<unsigned>(threads.size());
+    }
+
+    bool ThreadPool::pop(unsigned q, std::function<void()>& task) {
+        Queue& queue = *queues[q];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    // own queue first, then steal round the others from the oldest task
+    bool ThreadPool::run_one(unsigned first) {
+        std::function<void()> task;
+        bool found = first < queues.size() && pop(first, task);
+        for (unsigned k = 0; !found && k < queues.size(); k++) {
+            Queue& queue = *queues[(first + 1 + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        queued--;
+        task();
+        return true;
+    }
+
+    void ThreadPool::work(unsigned q) {
+        while (true) {
+            if (run_one(q)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle.wait(guard, [this]() { return stopping || queued > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    void ThreadPool::parallel_for(unsigned begin, unsigned end, const std::function<void(unsigned, unsigned)>& body,
+                                  unsigned grain) {
+        if (begin >= end) {
+            return;
+        }
+        // a few chunks per thread leave room for stealing
+        unsigned chunks = 4 * (size() + 1);
+        unsigned step = std::max(grain, (end - begin + chunks - 1) / chunks);
+        if (threads.empty() || end - begin <= step) {
+            body(begin, end);
+            return;
+        }
+
+        std::atomic<unsigned> remaining(0);
+        unsigned q = 0;
+        for (unsigned from = begin; from < end; from += step) {
+            unsigned to = std::min(end, from + step);
+            remaining++;
+            queued++;
+            Queue& queue = *queues[q++ % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back([&body, &remaining, from, to]() {
+                body(from, to);
+                remaining--;
+            });
+        }
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+        }
+        idle.notify_all();
+        while (remaining > 0) {
+            if (!run_one(static_cast<unsigned>(queues.size()))) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef DGRAPH_THREADPOOL_H
+#define DGRAPH_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dgraph {
+    // each worker owns a deque, runs its own tasks from the back and steals
+    // from the front of the others when it runs dry; the thread waiting in
+    // parallel_for takes part in the work as well
+    class ThreadPool {
+        struct Queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::mutex idle_lock;
+        std::condition_variable idle;
+        std::atomic<unsigned> queued;
+        bool stopping;
+
+        bool pop(unsigned q, std::function<void()>& task);
+        bool run_one(unsigned first);
+        void work(unsigned q);
+
+    public:
+        explicit ThreadPool(unsigned threads);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool();
+
+        unsigned size() const;
+        // calls body on disjoint subranges covering [begin, end), none shorter
+        // than grain but the last, and returns once all of them are done
+        void parallel_for(unsigned begin, unsigned end, const std::function<void(unsigned, unsigned)>& body,
+                          unsigned grain = 1024);
+    };
+}
+
+#endif //DGRAPH_THREADPOOL_H
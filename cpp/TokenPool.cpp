@@ -0,0 +1,41 @@
+#include "TokenPool.h"
+
+namespace dgraph {
+
+    EdgeToken TokenPool::acquire() {
+        unsigned slot;
+        if (free_slots.empty()) {
+            slot = static_cast<unsigned>(generations.size());
+            generations.push_back(0);
+            used.push_back(0);
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        used[slot] = 1;
+        return EdgeToken(slot, generations[slot]);
+    }
+
+    void TokenPool::release(unsigned slot) {
+        used[slot] = 0;
+        if (++generations[slot] != ~0u) {
+            free_slots.push_back(slot);
+        }
+    }
+
+    bool TokenPool::contains(const EdgeToken& token) const {
+        return token.edge < used.size() && used[token.edge] && generations[token.edge] == token.generation;
+    }
+
+    bool TokenPool::live(unsigned slot) const {
+        return slot < used.size() && used[slot];
+    }
+
+    unsigned TokenPool::size() const {
+        return static_cast<unsigned>(used.size());
+    }
+
+    unsigned TokenPool::slot(const EdgeToken& token) {
+        return token.edge;
+    }
+}
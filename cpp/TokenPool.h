@@ -0,0 +1,29 @@
+#ifndef DGRAPH_TOKENPOOL_H
+#define DGRAPH_TOKENPOOL_H
+
+#include "DynamicGraph.h"
+
+#include <vector>
+
+namespace dgraph {
+    // the slots and generations behind the tokens of a structure that is
+    // not a DynamicGraph itself, as DynamicForest; the owner keeps what an
+    // edge needs in arrays indexed by slot. A slot whose generation has run
+    // out is retired rather than handed out again
+    class TokenPool {
+        std::vector<unsigned> generations;
+        std::vector<unsigned char> used;
+        std::vector<unsigned> free_slots;
+    public:
+        // a free slot, or a new one at size() - 1
+        EdgeToken acquire();
+        void release(unsigned slot);
+        bool contains(const EdgeToken& token) const;
+        bool live(unsigned slot) const;
+        unsigned size() const;
+        // the slot a token names, for this pool or a graph
+        static unsigned slot(const EdgeToken& token);
+    };
+}
+
+#endif //DGRAPH_TOKENPOOL_H
@@ -0,0 +1,21 @@
+#ifndef DGRAPH_TRACE_H
+#define DGRAPH_TRACE_H
+
+namespace dgraph {
+    // one step of a recorded sequence: an edge added, an edge removed by
+    // its pair as DynamicGraph::remove(v, u) does, or a query answered in
+    // the order of the queries
+    struct TraceStep {
+        enum class Kind : unsigned char {
+            add,
+            remove,
+            query
+        };
+
+        Kind kind;
+        unsigned v;
+        unsigned u;
+    };
+}
+
+#endif //DGRAPH_TRACE_H
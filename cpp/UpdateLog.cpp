@@ -0,0 +1,444 @@
+#include "UpdateLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dgraph {
+    namespace {
+        const std::uint32_t LOG_MAGIC = 0x4c504744;
+        const std::uint32_t LOG_VERSION = 1;
+
+        // a zero byte where a record should start ends the log, it is what
+        // a file system may leave behind a write cut short
+        enum Tag : unsigned char {
+            END = 0,
+            ADD,
+            REMOVE,
+            ADD_BATCH,
+            REMOVE_BATCH,
+            INSERT_ONLY,
+            SAMPLING,
+            PROBE_BUDGET,
+            ADD_VERTEX,
+            REMOVE_VERTEX,
+            USE_LEVELS
+        };
+
+        std::string snapshot_path(const std::string& directory, unsigned seq) {
+            return directory + "/snapshot-" + std::to_string(seq);
+        }
+
+        std::string segment_path(const std::string& directory, unsigned seq) {
+            return directory + "/log-" + std::to_string(seq);
+        }
+
+        std::runtime_error failed(const std::string& what, const std::string& path) {
+            return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+        }
+
+        // sequence numbers of the files named prefix<seq>suffix, ascending
+        vector<unsigned> list(const std::string& directory, const std::string& prefix, const std::string& suffix) {
+            DIR* dir = opendir(directory.c_str());
+            if (dir == nullptr) {
+                throw failed("cannot list", directory);
+            }
+            vector<unsigned> found;
+            while (dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0
+                    || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                    continue;
+                }
+                std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+                if (digits.find_first_not_of("0123456789") == std::string::npos) {
+                    found.push_back(static_cast<unsigned>(std::strtoul(digits.c_str(), nullptr, 10)));
+                }
+            }
+            closedir(dir);
+            std::sort(found.begin(), found.end());
+            return found;
+        }
+
+        void write_all(int fd, const unsigned char* data, size_t size, const std::string& path) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw failed("cannot write", path);
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+        void sync_path(const std::string& path, int flags) {
+            int fd = ::open(path.c_str(), flags);
+            if (fd < 0 || ::fsync(fd) != 0) {
+                std::runtime_error error = failed("cannot sync", path);
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw error;
+            }
+            ::close(fd);
+        }
+
+        // reads a varint, false if the data ends inside it
+        bool get(const vector<unsigned char>& data, size_t& pos, unsigned& value) {
+            value = 0;
+            for (unsigned shift = 0; shift < 35; shift += 7) {
+                if (pos == data.size()) {
+                    return false;
+                }
+                unsigned char byte = data[pos++];
+                value |= static_cast<unsigned>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+            throw std::runtime_error("corrupt update log");
+        }
+
+        bool get_pairs(const vector<unsigned char>& data, size_t& pos, vector<std::pair<unsigned, unsigned>>& pairs) {
+            unsigned count;
+            if (!get(data, pos, count)) {
+                return false;
+            }
+            pairs.resize(count);
+            for (auto& pair : pairs) {
+                if (!get(data, pos, pair.first) || !get(data, pos, pair.second)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    UpdateLog::UpdateLog(const std::string& directory, DynamicGraph& graph, unsigned group)
+            : directory(directory), graph(&graph), group(std::max(1u, group)), fd(-1), segment(0), base(0),
+              target(0), records(0) {
+        if (::mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+            throw failed("cannot create", directory);
+        }
+        for (unsigned seq : list(directory, "snapshot-", ".tmp")) {
+            std::remove((snapshot_path(directory, seq) + ".tmp").c_str());
+        }
+        vector<unsigned> snapshots = list(directory, "snapshot-", "");
+        vector<unsigned> segments = list(directory, "log-", "");
+        if (snapshots.empty()) {
+            if (!segments.empty()) {
+                throw std::runtime_error("update log without a snapshot: " + directory);
+            }
+            graph.save(snapshot_path(directory, 0));
+            sync_path(snapshot_path(directory, 0), O_RDONLY);
+            sync_path(directory, O_RDONLY | O_DIRECTORY);
+        } else {
+            base = snapshots.back();
+            graph.load(snapshot_path(directory, base));
+            segment = base;
+            for (unsigned seq : segments) {
+                if (seq >= base) {
+                    replay(segment_path(directory, seq), graph);
+                    segment = seq + 1;
+                }
+            }
+            // left over by a compaction cut short once its snapshot was in place
+            for (unsigned seq : snapshots) {
+                if (seq < base) {
+                    std::remove(snapshot_path(directory, seq).c_str());
+                }
+            }
+            for (unsigned seq : segments) {
+                if (seq < base) {
+                    std::remove(segment_path(directory, seq).c_str());
+                }
+            }
+        }
+        target = base;
+        open_segment();
+        graph.set_log(this);
+    }
+
+    UpdateLog::~UpdateLog() {
+        graph->set_log(nullptr);
+        try {
+            close_segment();
+        } catch (const std::exception&) {
+        }
+        if (compactor.joinable()) {
+            compactor.join();
+        }
+    }
+
+    void UpdateLog::open_segment() {
+        std::string path = segment_path(directory, segment);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0666);
+        if (fd < 0) {
+            throw failed("cannot create", path);
+        }
+        const std::uint32_t header[2] = {LOG_MAGIC, LOG_VERSION};
+        write_all(fd, reinterpret_cast<const unsigned char*>(header), sizeof(header), path);
+        if (::fdatasync(fd) != 0) {
+            throw failed("cannot sync", path);
+        }
+        sync_path(directory, O_RDONLY | O_DIRECTORY);
+    }
+
+    void UpdateLog::close_segment() {
+        if (fd < 0) {
+            return;
+        }
+        sync();
+        ::close(fd);
+        fd = -1;
+    }
+
+    void UpdateLog::put(unsigned value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<unsigned char>(value));
+    }
+
+    void UpdateLog::end_record() {
+        if (++records >= group) {
+            sync();
+        }
+    }
+
+    void UpdateLog::sync() {
+        if (buffer.empty()) {
+            return;
+        }
+        std::string path = segment_path(directory, segment);
+        write_all(fd, buffer.data(), buffer.size(), path);
+        if (::fdatasync(fd) != 0) {
+            throw failed("cannot sync", path);
+        }
+        buffer.clear();
+        records = 0;
+    }
+
+    void UpdateLog::added(unsigned v, unsigned u) {
+        buffer.push_back(ADD);
+        put(v);
+        put(u);
+        end_record();
+    }
+
+    void UpdateLog::removed(const EdgeToken& token) {
+        buffer.push_back(REMOVE);
+        put(token.edge);
+        put(token.generation);
+        end_record();
+    }
+
+    void UpdateLog::added(const vector<std::pair<unsigned, unsigned>>& batch) {
+        buffer.push_back(ADD_BATCH);
+        put(static_cast<unsigned>(batch.size()));
+        for (const auto& e : batch) {
+            put(e.first);
+            put(e.second);
+        }
+        end_record();
+    }
+
+    void UpdateLog::removed(const vector<EdgeToken>& tokens) {
+        buffer.push_back(REMOVE_BATCH);
+        put(static_cast<unsigned>(tokens.size()));
+        for (const EdgeToken& token : tokens) {
+            put(token.edge);
+            put(token.generation);
+        }
+        end_record();
+    }
+
+    void UpdateLog::insert_only() {
+        buffer.push_back(INSERT_ONLY);
+        end_record();
+    }
+
+    void UpdateLog::use_levels() {
+        buffer.push_back(USE_LEVELS);
+        end_record();
+    }
+
+    void UpdateLog::vertex_added() {
+        buffer.push_back(ADD_VERTEX);
+        end_record();
+    }
+
+    void UpdateLog::vertex_removed(unsigned v) {
+        buffer.push_back(REMOVE_VERTEX);
+        put(v);
+        end_record();
+    }
+
+    void UpdateLog::sampling(unsigned samples) {
+        buffer.push_back(SAMPLING);
+        put(samples);
+        end_record();
+    }
+
+    void UpdateLog::probe_budget(unsigned budget) {
+        buffer.push_back(PROBE_BUDGET);
+        put(budget);
+        end_record();
+    }
+
+    // the pool hands out the same slots and generations to the same
+    // sequence of updates, so logged tokens name the same edges again;
+    // a record cut short by a crash is dropped with what follows it
+    void UpdateLog::replay(const std::string& path, DynamicGraph& graph) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("cannot read update log " + path);
+        }
+        vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::uint32_t header[2];
+        if (data.size() < sizeof(header)) {
+            return;
+        }
+        std::memcpy(header, data.data(), sizeof(header));
+        if (header[0] != LOG_MAGIC || header[1] != LOG_VERSION) {
+            throw std::runtime_error("not a version " + std::to_string(LOG_VERSION) + " update log: " + path);
+        }
+        size_t pos = sizeof(header);
+        vector<std::pair<unsigned, unsigned>> pairs;
+        while (pos < data.size()) {
+            unsigned char tag = data[pos++];
+            unsigned value;
+            switch (tag) {
+                case END:
+                    return;
+                case ADD:
+                    pairs.resize(1);
+                    if (!get(data, pos, pairs[0].first) || !get(data, pos, pairs[0].second)) {
+                        return;
+                    }
+                    graph.add(pairs[0].first, pairs[0].second);
+                    break;
+                case REMOVE:
+                    pairs.resize(1);
+                    if (!get(data, pos, pairs[0].first) || !get(data, pos, pairs[0].second)) {
+                        return;
+                    }
+                    graph.remove(EdgeToken(pairs[0].first, pairs[0].second));
+                    break;
+                case ADD_BATCH:
+                    if (!get_pairs(data, pos, pairs)) {
+                        return;
+                    }
+                    graph.add_batch(pairs);
+                    break;
+                case REMOVE_BATCH: {
+                    if (!get_pairs(data, pos, pairs)) {
+                        return;
+                    }
+                    vector<EdgeToken> tokens;
+                    tokens.reserve(pairs.size());
+                    for (const auto& token : pairs) {
+                        tokens.push_back(EdgeToken(token.first, token.second));
+                    }
+                    graph.remove_batch(tokens);
+                    break;
+                }
+                case INSERT_ONLY:
+                    graph.insert_only();
+                    break;
+                case SAMPLING:
+                    if (!get(data, pos, value)) {
+                        return;
+                    }
+                    graph.set_sampling(value);
+                    break;
+                case PROBE_BUDGET:
+                    if (!get(data, pos, value)) {
+                        return;
+                    }
+                    graph.set_probe_budget(value);
+                    break;
+                case ADD_VERTEX:
+                    graph.add_vertex();
+                    break;
+                case REMOVE_VERTEX:
+                    if (!get(data, pos, value)) {
+                        return;
+                    }
+                    graph.remove_vertex(value);
+                    break;
+                case USE_LEVELS:
+                    graph.use_levels();
+                    break;
+                default:
+                    throw std::runtime_error("corrupt update log " + path);
+            }
+        }
+    }
+
+    void UpdateLog::compact() {
+        finish_compaction();
+        close_segment();
+        unsigned last = segment++;
+        open_segment();
+        target = last + 1;
+        std::string directory = this->directory;
+        unsigned from = base;
+        compactor = std::thread([this, directory, from, last]() {
+            try {
+                fold(directory, from, last);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        });
+    }
+
+    void UpdateLog::finish_compaction() {
+        if (!compactor.joinable()) {
+            return;
+        }
+        compactor.join();
+        if (failure) {
+            std::exception_ptr error = failure;
+            failure = nullptr;
+            std::rethrow_exception(error);
+        }
+        base = target;
+    }
+
+    // the new snapshot only replaces the old one by a rename, so a crash
+    // at any point leaves either of them with the segments it needs
+    void UpdateLog::fold(const std::string& directory, unsigned base, unsigned last) {
+        DynamicGraph graph(0);
+        graph.load(snapshot_path(directory, base));
+        for (unsigned seq = base; seq <= last; seq++) {
+            replay(segment_path(directory, seq), graph);
+        }
+        std::string path = snapshot_path(directory, last + 1);
+        graph.save(path + ".tmp");
+        sync_path(path + ".tmp", O_RDONLY);
+        if (std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+            throw failed("cannot rename", path);
+        }
+        sync_path(directory, O_RDONLY | O_DIRECTORY);
+        std::remove(snapshot_path(directory, base).c_str());
+        for (unsigned seq = base; seq <= last; seq++) {
+            std::remove(segment_path(directory, seq).c_str());
+        }
+    }
+}
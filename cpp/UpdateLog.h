@@ -0,0 +1,72 @@
+#ifndef DGRAPH_UPDATELOG_H
+#define DGRAPH_UPDATELOG_H
+
+#include "DynamicGraph.h"
+
+#include <exception>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dgraph {
+    // an append-only log of the updates of one graph next to snapshots of
+    // it, all in one directory: snapshot-S holds the state before log
+    // segment S and every later segment is replayed on top of it. Records
+    // are a tag and varints, buffered and written with one fdatasync per
+    // group of them, so a crash loses at most the group not yet committed
+    class UpdateLog {
+        std::string directory;
+        DynamicGraph* graph;
+        unsigned group;
+        int fd;
+        unsigned segment;
+        unsigned base;
+        unsigned target;
+        std::vector<unsigned char> buffer;
+        unsigned records;
+        std::thread compactor;
+        std::exception_ptr failure;
+
+        void open_segment();
+        void close_segment();
+        void put(unsigned value);
+        void end_record();
+        static void replay(const std::string& path, DynamicGraph& graph);
+        static void fold(const std::string& directory, unsigned base, unsigned last);
+
+    public:
+        // recovers the graph from the directory if it holds a log, the graph
+        // is then replaced by the logged state; otherwise the graph as it is
+        // becomes the first snapshot. From here on the graph writes its
+        // updates to the log
+        UpdateLog(const std::string& directory, DynamicGraph& graph, unsigned group = 256);
+        UpdateLog(const UpdateLog&) = delete;
+        UpdateLog& operator=(const UpdateLog&) = delete;
+        ~UpdateLog();
+
+        // written by the graph
+        void added(unsigned v, unsigned u);
+        void removed(const EdgeToken& token);
+        void added(const std::vector<std::pair<unsigned, unsigned>>& batch);
+        void removed(const std::vector<EdgeToken>& tokens);
+        void insert_only();
+        void use_levels();
+        void vertex_added();
+        void vertex_removed(unsigned v);
+        void sampling(unsigned samples);
+        void probe_budget(unsigned budget);
+
+        // commits the records buffered so far
+        void sync();
+        // starts a new segment and folds the closed ones into a new snapshot
+        // on a thread of its own; the graph is not touched, a new snapshot
+        // is built from the last one and the log. Throws what the previous
+        // compaction failed with, if it did
+        void compact();
+        // waits for the running compaction
+        void finish_compaction();
+    };
+}
+
+#endif //DGRAPH_UPDATELOG_H
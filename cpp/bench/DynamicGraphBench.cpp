@@ -0,0 +1,366 @@
+#include "../DynamicForest.h"
+#include "../DynamicGraph.h"
+#include "../OfflineConnectivity.h"
+#include "../UpdateLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+    using std::vector;
+    using clock_type = std::chrono::steady_clock;
+
+    double seconds_since(clock_type::time_point start) {
+        return std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+
+    void report(const std::string& name, unsigned ops, double seconds) {
+        std::cout << name << ": " << ops << " ops in " << seconds << " s, "
+                  << seconds * 1e9 / ops << " ns/op" << std::endl;
+    }
+
+    // bytes allocated and not yet freed, where the allocator tells
+    double allocated() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        // large blocks are mapped on their own and not in uordblks
+        struct mallinfo2 info = mallinfo2();
+        return static_cast<double>(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+        // before glibc 2.33 only int fields, good up to 4 GiB read unsigned
+        struct mallinfo info = mallinfo();
+        return static_cast<double>(static_cast<unsigned>(info.uordblks) + static_cast<unsigned>(info.hblkhd));
+#else
+        return 0;
+#endif
+    }
+
+    // the tail of the per operation times rather than their mean
+    void report_latency(const std::string& name, vector<double> times) {
+        std::sort(times.begin(), times.end());
+        double total = 0;
+        for (double t : times) {
+            total += t;
+        }
+        auto at = [&](double q) {
+            return times[std::min(times.size() - 1, static_cast<size_t>(q * times.size()))] * 1e9;
+        };
+        std::cout << name << ": mean " << total * 1e9 / times.size() << " ns, p99 " << at(0.99)
+                  << " ns, p99.99 " << at(0.9999) << " ns, max " << times.back() * 1e9 << " ns" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    unsigned n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    unsigned m = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2 * n;
+    unsigned ops = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : m;
+    unsigned threads = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0;
+    unsigned samples = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 16;
+    unsigned budget = argc > 6 ? std::strtoul(argv[6], nullptr, 10) : 64;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<unsigned> vertex(0, n - 1);
+
+    dgraph::DynamicGraph graph(n);
+    graph.set_sampling(samples);
+    graph.set_probe_budget(budget);
+    vector<dgraph::EdgeToken> tokens;
+    tokens.reserve(m);
+
+    auto start = clock_type::now();
+    for (unsigned i = 0; i < m; i++) {
+        tokens.push_back(graph.add(vertex(rng), vertex(rng)));
+    }
+    report("insert", m, seconds_since(start));
+
+    start = clock_type::now();
+    for (unsigned i = 0; i < ops; i++) {
+        std::uniform_int_distribution<unsigned> pick(0, static_cast<unsigned>(tokens.size()) - 1);
+        unsigned j = pick(rng);
+        graph.remove(std::move(tokens[j]));
+        tokens[j] = graph.add(vertex(rng), vertex(rng));
+    }
+    report("remove+insert", ops, seconds_since(start));
+    const dgraph::ProbeStats& probes = graph.probe_stats();
+    std::cout << "local search: " << probes.runs << " runs, " << probes.replaced << " replaced, "
+              << probes.split << " split, " << probes.scanned << " edges scanned" << std::endl;
+
+    {
+        const std::string directory = "dgraph_bench.log";
+        std::remove((directory + "/snapshot-0").c_str());
+        std::remove((directory + "/log-0").c_str());
+        dgraph::UpdateLog log(directory, graph);
+        start = clock_type::now();
+        for (unsigned i = 0; i < ops; i++) {
+            std::uniform_int_distribution<unsigned> pick(0, static_cast<unsigned>(tokens.size()) - 1);
+            unsigned j = pick(rng);
+            graph.remove(std::move(tokens[j]));
+            tokens[j] = graph.add(vertex(rng), vertex(rng));
+        }
+        log.sync();
+        report("remove+insert logged", ops, seconds_since(start));
+        std::remove((directory + "/snapshot-0").c_str());
+        std::remove((directory + "/log-0").c_str());
+        rmdir(directory.c_str());
+    }
+
+    start = clock_type::now();
+    unsigned connected = 0;
+    for (unsigned i = 0; i < ops; i++) {
+        connected += graph.is_connected(vertex(rng), vertex(rng));
+    }
+    report("is_connected", ops, seconds_since(start));
+
+    vector<std::pair<unsigned, unsigned>> pairs(ops);
+    for (auto& pair : pairs) {
+        pair = std::make_pair(vertex(rng), vertex(rng));
+    }
+    start = clock_type::now();
+    vector<unsigned char> answers = graph.is_connected(pairs);
+    report("is_connected bulk", ops, seconds_since(start));
+    for (unsigned char answer : answers) {
+        connected += answer;
+    }
+
+    start = clock_type::now();
+    while (!tokens.empty()) {
+        graph.remove(std::move(tokens.back()));
+        tokens.pop_back();
+    }
+    report("remove", m, seconds_since(start));
+
+    const unsigned batch_size = 10000;
+    dgraph::ThreadPool pool(threads);
+    dgraph::DynamicGraph batched(n);
+    batched.set_sampling(samples);
+    batched.set_probe_budget(budget);
+    start = clock_type::now();
+    for (unsigned i = 0; i < m; i += batch_size) {
+        vector<std::pair<unsigned, unsigned>> batch;
+        for (unsigned k = i; k < m && k < i + batch_size; k++) {
+            batch.push_back(std::make_pair(vertex(rng), vertex(rng)));
+        }
+        vector<dgraph::EdgeToken> added = batched.add_batch(batch, pool);
+        tokens.insert(tokens.end(), added.begin(), added.end());
+    }
+    report("add_batch", m, seconds_since(start));
+
+    start = clock_type::now();
+    while (!tokens.empty()) {
+        unsigned k = tokens.size() > batch_size ? static_cast<unsigned>(tokens.size()) - batch_size : 0;
+        vector<dgraph::EdgeToken> batch(tokens.begin() + k, tokens.end());
+        tokens.resize(k);
+        batched.remove_batch(batch, pool);
+    }
+    report("remove_batch", m, seconds_since(start));
+
+    vector<std::pair<unsigned, unsigned>> list(m);
+    for (auto& pair : list) {
+        pair = std::make_pair(vertex(rng), vertex(rng));
+    }
+    start = clock_type::now();
+    {
+        vector<dgraph::EdgeToken> built;
+        dgraph::DynamicGraph graph_from_list(n, list, built);
+        report("from edge list", m, seconds_since(start));
+
+        const char* path = "dgraph_bench.snapshot";
+        start = clock_type::now();
+        graph_from_list.save(path);
+        report("save", m, seconds_since(start));
+        start = clock_type::now();
+        dgraph::DynamicGraph restored(n);
+        restored.load(path);
+        report("load", m, seconds_since(start));
+        std::remove(path);
+
+        start = clock_type::now();
+        restored.has_edge(list[0].first, list[0].second);
+        report("pair index", m, seconds_since(start));
+        start = clock_type::now();
+        unsigned found = 0;
+        for (unsigned i = 0; i < ops; i++) {
+            found += restored.has_edge(list[i % m].first, list[i % m].second);
+        }
+        report("has_edge", ops, seconds_since(start));
+        start = clock_type::now();
+        for (unsigned i = 0; i < ops && i < m; i++) {
+            restored.remove(list[i].first, list[i].second);
+        }
+        report("remove by pair", std::min(ops, m), seconds_since(start));
+        connected += found;
+    }
+
+    dgraph::DynamicGraph ingested(n);
+    ingested.insert_only();
+    start = clock_type::now();
+    for (unsigned i = 0; i < m; i++) {
+        tokens.push_back(ingested.add(vertex(rng), vertex(rng)));
+    }
+    report("insert only", m, seconds_since(start));
+    start = clock_type::now();
+    ingested.remove(std::move(tokens.back()));
+    tokens.pop_back();
+    report("hand-over", 1, seconds_since(start));
+
+    // a trace over the same vertices: m additions up front, then removals,
+    // additions and queries in turns
+    vector<dgraph::TraceStep> trace;
+    vector<std::pair<unsigned, unsigned>> alive;
+    for (unsigned i = 0; i < m + 3 * ops; i++) {
+        unsigned v = vertex(rng);
+        unsigned u = vertex(rng);
+        if (i < m || i % 3 == 0) {
+            trace.push_back({dgraph::TraceStep::Kind::add, v, u});
+            alive.emplace_back(v, u);
+        } else if (i % 3 == 1) {
+            std::uniform_int_distribution<unsigned> pick(0, static_cast<unsigned>(alive.size()) - 1);
+            unsigned j = pick(rng);
+            trace.push_back({dgraph::TraceStep::Kind::remove, alive[j].first, alive[j].second});
+            alive[j] = alive.back();
+            alive.pop_back();
+        } else {
+            trace.push_back({dgraph::TraceStep::Kind::query, v, u});
+        }
+    }
+    {
+        dgraph::DynamicGraph online(n);
+        online.set_sampling(samples);
+        online.set_probe_budget(budget);
+        start = clock_type::now();
+        vector<unsigned char> expected = online.replay(trace);
+        report("trace online", static_cast<unsigned>(trace.size()), seconds_since(start));
+        dgraph::OfflineConnectivity offline(n);
+        start = clock_type::now();
+        vector<unsigned char> found = threads > 0 ? offline.run(trace, pool) : offline.run(trace);
+        report("trace offline", static_cast<unsigned>(trace.size()), seconds_since(start));
+        if (found != expected) {
+            std::cout << "offline answers differ" << std::endl;
+        }
+    }
+
+    // a random tree whose edges are cut and their ends linked elsewhere,
+    // the moves picked once and then timed on both structures
+    vector<std::pair<unsigned, unsigned>> tree;
+    vector<std::pair<unsigned, std::pair<unsigned, unsigned>>> moves;
+    {
+        dgraph::DynamicForest scratch(n);
+        vector<dgraph::EdgeToken> links;
+        vector<std::pair<unsigned, unsigned>> ends;
+        for (unsigned v = 1; v < n; v++) {
+            tree.emplace_back(v, std::uniform_int_distribution<unsigned>(0, v - 1)(rng));
+            links.push_back(scratch.add(tree.back().first, tree.back().second));
+            ends.push_back(tree.back());
+        }
+        std::uniform_int_distribution<unsigned> pick(0, n - 2);
+        for (unsigned i = 0; i < ops; i++) {
+            unsigned k = pick(rng);
+            scratch.remove(std::move(links[k]));
+            // the cut left the ends apart, so one of them is apart from u
+            unsigned u = vertex(rng);
+            unsigned v = scratch.is_connected(ends[k].first, u) ? ends[k].second : ends[k].first;
+            links[k] = scratch.add(v, u);
+            ends[k] = std::make_pair(v, u);
+            moves.emplace_back(k, std::make_pair(v, u));
+        }
+    }
+    {
+        dgraph::DynamicForest forest(n);
+        vector<dgraph::EdgeToken> links;
+        start = clock_type::now();
+        for (const auto& e : tree) {
+            links.push_back(forest.add(e.first, e.second));
+        }
+        for (const auto& move : moves) {
+            forest.remove(std::move(links[move.first]));
+            links[move.first] = forest.add(move.second.first, move.second.second);
+        }
+        report("forest link+cut", n - 1 + 2 * ops, seconds_since(start));
+    }
+    {
+        dgraph::DynamicGraph acyclic(n);
+        vector<dgraph::EdgeToken> links;
+        start = clock_type::now();
+        for (const auto& e : tree) {
+            links.push_back(acyclic.add(e.first, e.second));
+        }
+        for (const auto& move : moves) {
+            acyclic.remove(std::move(links[move.first]));
+            links[move.first] = acyclic.add(move.second.first, move.second.second);
+        }
+        report("graph link+cut", n - 1 + 2 * ops, seconds_since(start));
+    }
+
+    // many graphs of a few hundred vertices, on bit rows and on the levels
+    for (bool levels : {false, true}) {
+        const unsigned instances = 2000;
+        const unsigned tiny_n = 300;
+        const unsigned tiny_m = 600;
+        std::uniform_int_distribution<unsigned> tiny_vertex(0, tiny_n - 1);
+        double before = allocated();
+        vector<std::unique_ptr<dgraph::DynamicGraph>> graphs;
+        vector<vector<dgraph::EdgeToken>> handles(instances);
+        for (unsigned g = 0; g < instances; g++) {
+            graphs.emplace_back(new dgraph::DynamicGraph(tiny_n));
+            if (levels) {
+                graphs.back()->use_levels();
+            }
+            for (unsigned i = 0; i < tiny_m; i++) {
+                handles[g].push_back(graphs.back()->add(tiny_vertex(rng), tiny_vertex(rng)));
+            }
+        }
+        double bytes = allocated() - before;
+        start = clock_type::now();
+        for (unsigned i = 0; i < ops; i++) {
+            unsigned g = i % instances;
+            unsigned j = std::uniform_int_distribution<unsigned>(0, tiny_m - 1)(rng);
+            graphs[g]->remove(std::move(handles[g][j]));
+            handles[g][j] = graphs[g]->add(tiny_vertex(rng), tiny_vertex(rng));
+        }
+        report(levels ? "tiny graphs on levels remove+insert" : "tiny graphs remove+insert", ops,
+               seconds_since(start));
+        std::cout << "tiny graphs: " << bytes / instances / 1024 << " KiB each" << std::endl;
+    }
+
+    // the same remove+insert stream timed one pair at a time
+    vector<std::pair<unsigned, unsigned>> initial(m);
+    for (auto& e : initial) {
+        e = std::make_pair(vertex(rng), vertex(rng));
+    }
+    vector<std::pair<unsigned, std::pair<unsigned, unsigned>>> churn(ops);
+    for (auto& move : churn) {
+        move.first = std::uniform_int_distribution<unsigned>(0, m - 1)(rng);
+        move.second = std::make_pair(vertex(rng), vertex(rng));
+    }
+    vector<double> times(ops);
+    {
+        dgraph::DynamicGraph levelled(n);
+        levelled.set_sampling(samples);
+        levelled.set_probe_budget(budget);
+        vector<dgraph::EdgeToken> handles;
+        for (const auto& e : initial) {
+            handles.push_back(levelled.add(e.first, e.second));
+        }
+        for (unsigned i = 0; i < ops; i++) {
+            auto began = clock_type::now();
+            levelled.remove(std::move(handles[churn[i].first]));
+            handles[churn[i].first] = levelled.add(churn[i].second.first, churn[i].second.second);
+            times[i] = seconds_since(began);
+        }
+        report_latency("remove+insert latency", times);
+    }
+    std::cout << "connected pairs: " << connected << std::endl;
+    return 0;
+}
@@ -1,9 +1,23 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include "../DynamicForest.h"
 #include "../DynamicGraph.h"
+#include "../OfflineConnectivity.h"
+#include "../Snapshot.h"
+#include "../UpdateLog.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
 #include <queue>
 #include <random>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <unistd.h>
 
 namespace {
     using std::vector;
@@ -71,6 +85,29 @@ namespace {
             return true;
         }
 
+        vector<unsigned> components() {
+            vector<unsigned> label(adj.size(), adj.size());
+            for (unsigned s = 0; s < adj.size(); s++) {
+                if (label[s] != adj.size()) {
+                    continue;
+                }
+                queue<unsigned> q;
+                label[s] = s;
+                q.push(s);
+                while (!q.empty()) {
+                    unsigned w = q.front();
+                    q.pop();
+                    for (unsigned i = 0; i < adj.size(); i++) {
+                        if (adj[w][i] && label[i] == adj.size()) {
+                            label[i] = s;
+                            q.push(i);
+                        }
+                    }
+                }
+            }
+            return label;
+        }
+
         unsigned degree(unsigned v) {
             unsigned sum = 0;
             for (unsigned i = 0; i < adj.size(); i++) {
@@ -106,6 +143,66 @@ namespace {
         INFO("connectivity problem");
         REQUIRE(graph.is_connected() == reference.is_connected());
     }
+
+    template <typename Graph>
+    void check_components(unsigned size, Graph& graph, ReferenceGraph& reference) {
+        vector<unsigned> label = reference.components();
+        vector<unsigned> count(size, 0);
+        for (unsigned i = 0; i < size; i++) {
+            count[label[i]]++;
+        }
+        for (unsigned i = 0; i < size; i++) {
+            INFO("vertex " << i);
+            REQUIRE(graph.is_connected(i, label[i]));
+            REQUIRE(graph.component_size(i) == count[label[i]]);
+            REQUIRE(graph.degree(i) == reference.degree(i));
+        }
+        for (unsigned i = 1; i < size; i++) {
+            INFO(i - 1 << " and " << i);
+            REQUIRE(graph.is_connected(i - 1, i) == (label[i - 1] == label[i]));
+        }
+        REQUIRE(graph.is_connected() == reference.is_connected());
+    }
+
+    // new pairs added and edges removed at random, a removal one step in
+    // odds and every step while more than limit edges are in; an acyclic
+    // graph has to turn down just the edges that would close a cycle
+    template <typename Graph>
+    void random_updates(unsigned size, Graph& graph, std::mt19937& rng, unsigned ops, unsigned limit, unsigned odds,
+                        unsigned every, bool acyclic = false) {
+        ReferenceGraph reference(size);
+        vector<std::pair<std::pair<unsigned, unsigned>, dgraph::EdgeToken>> edges;
+        for (unsigned i = 0; i < ops; i++) {
+            bool removal = !edges.empty() && (edges.size() > limit || rng() % odds == 0);
+            if (removal) {
+                unsigned j = rng() % edges.size();
+                dgraph::EdgeToken stale = edges[j].second;
+                reference.remove(edges[j].first.first, edges[j].first.second);
+                graph.remove(std::move(edges[j].second));
+                REQUIRE(!graph.contains(stale));
+                std::swap(edges[j], edges.back());
+                edges.pop_back();
+            } else {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                if (v == u || reference.is_edge(v, u)) {
+                    continue;
+                }
+                bool cycle = acyclic && reference.is_connected(v, u);
+                dgraph::EdgeToken token = graph.add(v, u);
+                REQUIRE(token.moved() == cycle);
+                if (!cycle) {
+                    REQUIRE(graph.contains(token));
+                    reference.add(v, u);
+                    edges.push_back(std::make_pair(std::make_pair(v, u), token));
+                }
+            }
+            if (i % every == 0) {
+                INFO("op " << i);
+                check_components(size, graph, reference);
+            }
+        }
+    }
 }
 
 TEST_CASE("double std::moving of a token", "[dg_ref]") {
@@ -116,6 +213,796 @@ TEST_CASE("double std::moving of a token", "[dg_ref]") {
     REQUIRE(token.moved());
 }
 
+TEST_CASE("stale tokens are detected after their slot is reused", "[dg_ref]") {
+    dgraph::DynamicGraph graph(3);
+    auto token = graph.add(0, 1);
+    auto stale = token;
+    REQUIRE(graph.contains(stale));
+    graph.remove(std::move(token));
+    REQUIRE(!graph.contains(stale));
+    auto fresh = graph.add(1, 2);
+    REQUIRE(graph.contains(fresh));
+    REQUIRE(!graph.contains(stale));
+    graph.remove(std::move(stale));
+    REQUIRE(stale.moved());
+    REQUIRE(graph.contains(fresh));
+    REQUIRE(graph.is_connected(1, 2));
+}
+
+TEST_CASE("batches with repeated pairs and tokens", "[dg_ref]") {
+    dgraph::DynamicGraph graph(4);
+    vector<std::pair<unsigned, unsigned>> batch = {{0, 1}, {1, 0}, {0, 1}, {2, 2}, {1, 2}};
+    auto tokens = graph.add_batch(batch);
+    REQUIRE(tokens.size() == batch.size());
+    REQUIRE(tokens[3].moved());
+    REQUIRE(graph.degree(0) == 3);
+    REQUIRE(graph.degree(1) == 4);
+    REQUIRE(graph.component_size(0) == 3);
+
+    vector<dgraph::EdgeToken> removed = {tokens[0], tokens[0], tokens[1], tokens[3]};
+    graph.remove_batch(removed);
+    REQUIRE(removed.empty());
+    REQUIRE(graph.degree(0) == 1);
+    REQUIRE(graph.is_connected(0, 2));
+    REQUIRE(graph.contains(tokens[2]));
+    REQUIRE(!graph.contains(tokens[1]));
+
+    removed = {tokens[2], tokens[4]};
+    graph.remove_batch(removed);
+    REQUIRE(!graph.is_connected(0, 1));
+    REQUIRE(!graph.is_connected(1, 2));
+    REQUIRE(graph.component_size(1) == 1);
+}
+
+TEST_CASE("a graph built from an edge list", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 200;
+        std::mt19937 rng(23);
+        ReferenceGraph reference(size);
+        vector<std::pair<unsigned, unsigned>> list;
+        for (unsigned i = 0; i < 250; i++) {
+            unsigned v = rng() % size;
+            unsigned u = rng() % size;
+            if (v != u && !reference.is_edge(v, u)) {
+                reference.add(v, u);
+                list.push_back(std::make_pair(v, u));
+            }
+        }
+        vector<dgraph::EdgeToken> tokens;
+        dgraph::DynamicGraph graph(size, list, tokens);
+        if (levels) {
+            graph.use_levels();
+        }
+        REQUIRE(tokens.size() == list.size());
+        check_components(size, graph, reference);
+        for (unsigned i = 0; i < list.size(); i += 2) {
+            reference.remove(list[i].first, list[i].second);
+            graph.remove(std::move(tokens[i]));
+            check_components(size, graph, reference);
+        }
+    }
+}
+
+TEST_CASE("a built forest links and cuts like a linked one", "[dg]") {
+    dgraph::EulerTourForest forest(5);
+    forest.build({{0, 1}, {2, 3}});
+    forest.link(1, 2);
+    REQUIRE(!forest.is_connected(0, 4));
+    REQUIRE(!forest.is_connected());
+    REQUIRE(forest.is_connected(0, 3));
+
+    // built trees joined by replacements, then cut again in batches
+    const unsigned size = 40;
+    for (unsigned seed = 0; seed < 200; seed++) {
+        std::mt19937 rng(seed);
+        ReferenceGraph reference(size);
+        vector<std::pair<unsigned, unsigned>> list;
+        for (unsigned i = 0; i < 30; i++) {
+            unsigned v = rng() % size;
+            unsigned u = rng() % size;
+            if (v != u && !reference.is_edge(v, u)) {
+                reference.add(v, u);
+                list.push_back(std::make_pair(v, u));
+            }
+        }
+        vector<dgraph::EdgeToken> tokens;
+        dgraph::DynamicGraph graph(size, list, tokens);
+        graph.use_levels();
+        vector<std::pair<unsigned, unsigned>> ends(list);
+        for (unsigned round = 0; round < 20; round++) {
+            vector<std::pair<unsigned, unsigned>> batch;
+            for (unsigned k = 0; k < 4; k++) {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                if (v != u && !reference.is_edge(v, u)) {
+                    reference.add(v, u);
+                    batch.push_back(std::make_pair(v, u));
+                }
+            }
+            auto added = graph.add_batch(batch);
+            tokens.insert(tokens.end(), added.begin(), added.end());
+            ends.insert(ends.end(), batch.begin(), batch.end());
+            vector<dgraph::EdgeToken> removed;
+            for (unsigned k = 0; k < 3 && !tokens.empty(); k++) {
+                unsigned j = rng() % tokens.size();
+                reference.remove(ends[j].first, ends[j].second);
+                removed.push_back(tokens[j]);
+                tokens[j] = tokens.back();
+                ends[j] = ends.back();
+                tokens.pop_back();
+                ends.pop_back();
+            }
+            graph.remove_batch(removed);
+            INFO("seed " << seed << ", round " << round);
+            check_components(size, graph, reference);
+        }
+    }
+}
+
+TEST_CASE("a loaded snapshot goes on like the saved graph", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 200;
+        const char* path = "dgraph_snapshot_test.bin";
+        std::mt19937 rng(29);
+        dgraph::DynamicGraph saved(size);
+        if (levels) {
+            saved.use_levels();
+        }
+        vector<dgraph::EdgeToken> tokens;
+        for (unsigned i = 0; i < 3000; i++) {
+            if (!tokens.empty() && (tokens.size() > size || rng() % 3 == 0)) {
+                unsigned j = rng() % tokens.size();
+                saved.remove(std::move(tokens[j]));
+                std::swap(tokens[j], tokens.back());
+                tokens.pop_back();
+            } else {
+                tokens.push_back(saved.add(rng() % size, rng() % size));
+            }
+        }
+        saved.save(path);
+        dgraph::DynamicGraph loaded(1);
+        loaded.load(path);
+        std::remove(path);
+        REQUIRE(loaded.str() == saved.str());
+        REQUIRE(loaded.on_levels() == levels);
+
+        vector<dgraph::EdgeToken> copies(tokens);
+        for (unsigned i = 0; i < 3000; i++) {
+            if (!tokens.empty() && (tokens.size() > size || rng() % 3 == 0)) {
+                unsigned j = rng() % tokens.size();
+                saved.remove(std::move(tokens[j]));
+                loaded.remove(std::move(copies[j]));
+                std::swap(tokens[j], tokens.back());
+                std::swap(copies[j], copies.back());
+                tokens.pop_back();
+                copies.pop_back();
+            } else {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                tokens.push_back(saved.add(v, u));
+                copies.push_back(loaded.add(v, u));
+            }
+        }
+        REQUIRE(loaded.str() == saved.str());
+        REQUIRE(loaded.probe_stats().runs == saved.probe_stats().runs);
+        for (unsigned v = 0; v < size; v++) {
+            REQUIRE(loaded.component_size(v) == saved.component_size(v));
+            REQUIRE(loaded.degree(v) == saved.degree(v));
+        }
+    }
+}
+
+TEST_CASE("a corrupt snapshot is refused", "[dg]") {
+    const char* path = "dgraph_corrupt_test.bin";
+    dgraph::DynamicGraph saved(20);
+    saved.use_levels();
+    for (unsigned v = 1; v < 20; v++) {
+        saved.add(v - 1, v);
+        saved.add(0, v);
+    }
+    saved.save(path);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto refused = [&](const std::string& data) {
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), data.size());
+        }
+        dgraph::DynamicGraph loaded(1);
+        REQUIRE_THROWS_AS(loaded.load(path), const std::runtime_error&);
+    };
+    refused(bytes.substr(0, bytes.size() / 2));
+    // the length of the first array, the keys of the top level's vertex map
+    std::string huge(bytes);
+    for (unsigned k = 24; k < 32; k++) {
+        huge[k] = static_cast<char>(0x7f);
+    }
+    refused(huge);
+    // and one the vector could hold but the file does not
+    for (unsigned k = 24; k < 32; k++) {
+        huge[k] = static_cast<char>(k == 29 ? 1 : 0);
+    }
+    refused(huge);
+    std::remove(path);
+
+    std::stringstream stream;
+    dgraph::snapshot::write_array(stream, vector<unsigned>{0, 5, 3});
+    dgraph::snapshot::write_array(stream, vector<unsigned>{1, 2, 3});
+    vector<vector<unsigned>> lists;
+    REQUIRE_THROWS_AS(dgraph::snapshot::read_nested(stream, lists), const std::runtime_error&);
+}
+
+TEST_CASE("a graph recovered from its update log", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 200;
+        const std::string directory = "dgraph_log_test";
+        std::mt19937 rng(31);
+        auto files = [&]() {
+            vector<std::string> names;
+            if (DIR* dir = opendir(directory.c_str())) {
+                while (dirent* entry = readdir(dir)) {
+                    if (entry->d_name[0] != '.') {
+                        names.push_back(entry->d_name);
+                    }
+                }
+                closedir(dir);
+            }
+            return names;
+        };
+        auto update = [&](vector<dgraph::DynamicGraph*> graphs, vector<vector<dgraph::EdgeToken>*> tokens) {
+            vector<dgraph::EdgeToken>& first = *tokens[0];
+            if (!first.empty() && (first.size() > size || rng() % 3 == 0)) {
+                unsigned j = rng() % first.size();
+                for (unsigned k = 0; k < graphs.size(); k++) {
+                    graphs[k]->remove(std::move((*tokens[k])[j]));
+                    std::swap((*tokens[k])[j], tokens[k]->back());
+                    tokens[k]->pop_back();
+                }
+            } else if (rng() % 50 == 0) {
+                vector<std::pair<unsigned, unsigned>> batch;
+                for (unsigned k = 0; k < 20; k++) {
+                    batch.emplace_back(rng() % size, rng() % size);
+                }
+                for (unsigned k = 0; k < graphs.size(); k++) {
+                    vector<dgraph::EdgeToken> added = graphs[k]->add_batch(batch);
+                    tokens[k]->insert(tokens[k]->end(), added.begin(), added.end());
+                }
+            } else {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                for (unsigned k = 0; k < graphs.size(); k++) {
+                    tokens[k]->push_back(graphs[k]->add(v, u));
+                }
+            }
+        };
+        for (const std::string& name : files()) {
+            std::remove((directory + "/" + name).c_str());
+        }
+
+        dgraph::DynamicGraph live(size);
+        if (levels) {
+            live.use_levels();
+        }
+        vector<dgraph::EdgeToken> tokens;
+        {
+            dgraph::UpdateLog log(directory, live, 16);
+            for (unsigned i = 0; i < 3000; i++) {
+                update({&live}, {&tokens});
+                if (i % 1000 == 999) {
+                    log.compact();
+                }
+            }
+            log.finish_compaction();
+        }
+        // one snapshot and the segment written since the last compaction
+        REQUIRE(files().size() == 2);
+
+        // a record cut short at the end is dropped
+        for (const std::string& name : files()) {
+            if (name.compare(0, 4, "log-") == 0) {
+                std::ofstream out(directory + "/" + name, std::ios::binary | std::ios::app);
+                out.put(1).put(static_cast<char>(0x85));
+            }
+        }
+        dgraph::DynamicGraph recovered(1);
+        vector<dgraph::EdgeToken> copies(tokens);
+        {
+            dgraph::UpdateLog log(directory, recovered);
+            REQUIRE(recovered.on_levels() == levels);
+            REQUIRE(recovered.str() == live.str());
+            for (unsigned i = 0; i < 2000; i++) {
+                update({&live, &recovered}, {&tokens, &copies});
+            }
+        }
+        dgraph::DynamicGraph again(1);
+        {
+            dgraph::UpdateLog log(directory, again);
+            REQUIRE(again.on_levels() == levels);
+            REQUIRE(again.str() == live.str());
+            REQUIRE(recovered.str() == live.str());
+            for (unsigned v = 0; v < size; v++) {
+                REQUIRE(again.component_size(v) == live.component_size(v));
+            }
+        }
+        for (const std::string& name : files()) {
+            std::remove((directory + "/" + name).c_str());
+        }
+        rmdir(directory.c_str());
+    }
+}
+
+TEST_CASE("a log recovered across the switch onto the levels", "[dg]") {
+    const std::string directory = "dgraph_switch_test";
+    auto clear = [&]() {
+        if (DIR* dir = opendir(directory.c_str())) {
+            while (dirent* entry = readdir(dir)) {
+                if (entry->d_name[0] != '.') {
+                    std::remove((directory + "/" + entry->d_name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+    };
+    clear();
+    dgraph::DynamicGraph live(6);
+    {
+        dgraph::UpdateLog log(directory, live);
+        dgraph::EdgeToken a = live.add(0, 1);
+        live.add(1, 2);
+        dgraph::EdgeToken b = live.add(0, 2);
+        live.use_levels();
+        vector<dgraph::EdgeToken> batch;
+        batch.push_back(std::move(a));
+        batch.push_back(std::move(b));
+        live.remove_batch(batch);
+        live.remove(live.add(3, 4));
+    }
+    dgraph::DynamicGraph recovered(1);
+    {
+        dgraph::UpdateLog log(directory, recovered);
+        REQUIRE(recovered.on_levels());
+        REQUIRE(recovered.str() == live.str());
+        REQUIRE(!recovered.is_connected(3, 4));
+        REQUIRE(!recovered.is_connected(0, 1));
+        REQUIRE(recovered.is_connected(1, 2));
+    }
+    clear();
+    rmdir(directory.c_str());
+}
+
+TEST_CASE("edges removed by their vertex pair", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 30;
+        std::mt19937 rng(37);
+        // past the limit the graph starts on the levels, where the index
+        // waits for its first use
+        dgraph::DynamicGraph graph(levels ? dgraph::DynamicGraph::SMALL_LIMIT + 1 : size);
+        ReferenceGraph reference(size);
+        vector<vector<unsigned>> count(size, vector<unsigned>(size, 0));
+        vector<dgraph::EdgeToken> tokens;
+        vector<std::pair<unsigned, unsigned>> ends;
+        for (unsigned i = 0; i < 50; i++) {
+            unsigned v = rng() % size;
+            unsigned u = (v + 1 + rng() % (size - 1)) % size;
+            tokens.push_back(graph.add(v, u));
+            ends.emplace_back(v, u);
+            count[v][u]++;
+            count[u][v]++;
+        }
+        for (unsigned k = 0; k < tokens.size(); k += 10) {
+            graph.remove(std::move(tokens[k]));
+            count[ends[k].first][ends[k].second]--;
+            count[ends[k].second][ends[k].first]--;
+        }
+        for (const auto& e : ends) {
+            if (count[e.first][e.second] > 0) {
+                reference.add(e.first, e.second);
+            }
+        }
+        // on the levels the index is only built here, on the first use
+        for (unsigned i = 0; i < 3000; i++) {
+            unsigned v = rng() % size;
+            unsigned u = rng() % (size / 3);
+            if (rng() % 2 == 0) {
+                graph.add(v, u);
+                if (v != u) {
+                    count[v][u]++;
+                    count[u][v]++;
+                    reference.add(v, u);
+                }
+            } else {
+                REQUIRE(graph.remove(v, u) == (count[v][u] > 0 && v != u));
+                if (count[v][u] > 0 && v != u) {
+                    count[v][u]--;
+                    count[u][v]--;
+                    if (count[v][u] == 0) {
+                        reference.remove(v, u);
+                    }
+                }
+            }
+            REQUIRE(graph.multiplicity(v, u) == (v == u ? 0 : count[v][u]));
+            REQUIRE(graph.has_edge(u, v) == (v != u && count[v][u] > 0));
+        }
+        for (unsigned v = 0; v < size; v++) {
+            unsigned degree = 0;
+            for (unsigned u = 0; u < size; u++) {
+                INFO(v << " and " << u);
+                REQUIRE(graph.multiplicity(v, u) == (v == u ? 0 : count[v][u]));
+                REQUIRE(graph.is_connected(v, u) == reference.is_connected(v, u));
+                degree += count[v][u];
+            }
+            REQUIRE(graph.degree(v) == degree);
+        }
+    }
+}
+
+TEST_CASE("vertices added and removed as the graph goes", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 60;
+        std::mt19937 rng(41);
+        dgraph::DynamicGraph graph(4);
+        if (levels) {
+            graph.use_levels();
+        }
+        ReferenceGraph reference(size);
+        vector<bool> alive(size, false);
+        vector<unsigned> vertices = {0, 1, 2, 3};
+        for (unsigned v : vertices) {
+            alive[v] = true;
+        }
+        vector<std::pair<std::pair<unsigned, unsigned>, dgraph::EdgeToken>> edges;
+        for (unsigned i = 0; i < 2000; i++) {
+            unsigned op = rng() % 20;
+            if (op == 0 && vertices.size() > 2) {
+                unsigned k = rng() % vertices.size();
+                unsigned v = vertices[k];
+                graph.remove_vertex(v);
+                alive[v] = false;
+                vertices[k] = vertices.back();
+                vertices.pop_back();
+                for (unsigned u = 0; u < size; u++) {
+                    reference.remove(v, u);
+                }
+                for (auto& edge : edges) {
+                    if (edge.first.first == v || edge.first.second == v) {
+                        REQUIRE(!graph.contains(edge.second));
+                    }
+                }
+            } else if (op == 1 && vertices.size() < size) {
+                unsigned v = graph.add_vertex();
+                REQUIRE(v < size);
+                REQUIRE(!alive[v]);
+                REQUIRE(graph.degree(v) == 0);
+                REQUIRE(graph.component_size(v) == 1);
+                alive[v] = true;
+                vertices.push_back(v);
+            } else if (op < 12) {
+                unsigned v = vertices[rng() % vertices.size()];
+                unsigned u = vertices[rng() % vertices.size()];
+                if (!reference.is_edge(v, u) && v != u) {
+                    reference.add(v, u);
+                    edges.emplace_back(std::make_pair(v, u), graph.add(v, u));
+                }
+            } else if (!edges.empty()) {
+                unsigned k = rng() % edges.size();
+                if (graph.contains(edges[k].second)) {
+                    reference.remove(edges[k].first.first, edges[k].first.second);
+                    graph.remove(std::move(edges[k].second));
+                }
+                edges[k] = edges.back();
+                edges.pop_back();
+            }
+            if (i % 100 == 0) {
+                unsigned components = 0;
+                vector<unsigned> label = reference.components();
+                for (unsigned v : vertices) {
+                    components += label[v] == v;
+                    for (unsigned u : vertices) {
+                        REQUIRE(graph.is_connected(v, u) == (label[v] == label[u]));
+                    }
+                    REQUIRE(graph.degree(v) == reference.degree(v));
+                }
+                REQUIRE(graph.is_connected() == (components == 1));
+            }
+        }
+    }
+}
+
+TEST_CASE("an offline run answers a trace like the online graph", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 80;
+        std::mt19937 rng(43);
+        vector<dgraph::TraceStep> trace;
+        vector<std::pair<unsigned, unsigned>> added;
+        for (unsigned i = 0; i < 20000; i++) {
+            unsigned op = rng() % 10;
+            if (op < 4 || added.empty()) {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                trace.push_back({dgraph::TraceStep::Kind::add, v, u});
+                added.emplace_back(v, u);
+            } else if (op < 7) {
+                // mostly pairs that were added, now and then one that was not
+                unsigned k = rng() % added.size();
+                unsigned v = op == 6 ? rng() % size : added[k].first;
+                unsigned u = op == 6 ? rng() % size : added[k].second;
+                trace.push_back({dgraph::TraceStep::Kind::remove, u, v});
+                if (op != 6) {
+                    added[k] = added.back();
+                    added.pop_back();
+                }
+            } else {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                trace.push_back({dgraph::TraceStep::Kind::query, v, u});
+            }
+        }
+        dgraph::DynamicGraph graph(size);
+        if (levels) {
+            graph.use_levels();
+        }
+        vector<unsigned char> online = graph.replay(trace);
+        dgraph::OfflineConnectivity offline(size);
+        REQUIRE(offline.run(trace) == online);
+        dgraph::ThreadPool pool(3);
+        REQUIRE(offline.run(trace, pool) == online);
+        REQUIRE(offline.run(vector<dgraph::TraceStep>()).empty());
+    }
+}
+
+TEST_CASE("a forest linked and cut at random", "[dg]") {
+    const unsigned size = 50;
+    std::mt19937 rng(53);
+    dgraph::DynamicForest forest(size);
+    random_updates(size, forest, rng, 5000, size, 3, 50, true);
+}
+
+TEST_CASE("a small graph on bit rows moved onto the levels", "[dg]") {
+    const unsigned size = 70;
+    std::mt19937 rng(67);
+    ReferenceGraph reference(size);
+    vector<vector<unsigned>> count(size, vector<unsigned>(size, 0));
+    dgraph::DynamicGraph graph(size);
+    REQUIRE(!graph.on_levels());
+    vector<std::pair<std::pair<unsigned, unsigned>, dgraph::EdgeToken>> edges;
+    for (unsigned i = 0; i < 8000; i++) {
+        if (i == 5000) {
+            graph.use_levels();
+            REQUIRE(graph.on_levels());
+        }
+        // parallel edges allowed, so a pair only goes once its last edge does
+        if (!edges.empty() && (edges.size() > 3 * size || rng() % 3 == 0)) {
+            unsigned j = rng() % edges.size();
+            unsigned v = edges[j].first.first;
+            unsigned u = edges[j].first.second;
+            graph.remove(std::move(edges[j].second));
+            if (--count[v][u] == 0) {
+                reference.remove(v, u);
+            }
+            count[u][v] = count[v][u];
+            std::swap(edges[j], edges.back());
+            edges.pop_back();
+        } else {
+            unsigned v = rng() % size;
+            unsigned u = rng() % (rng() % 4 == 0 ? 8 : size);
+            if (v == u) {
+                continue;
+            }
+            reference.add(v, u);
+            count[v][u]++;
+            count[u][v] = count[v][u];
+            edges.push_back(std::make_pair(std::make_pair(v, u), graph.add(v, u)));
+        }
+        if (i % 50 == 0) {
+            INFO("op " << i);
+            vector<unsigned> label = reference.components();
+            for (unsigned v = 0; v < size; v++) {
+                for (unsigned u = 0; u < size; u++) {
+                    REQUIRE(graph.is_connected(v, u) == (label[v] == label[u]));
+                }
+            }
+            REQUIRE(graph.multiplicity(edges.back().first.first, edges.back().first.second)
+                    == count[edges.back().first.first][edges.back().first.second]);
+        }
+    }
+
+    // past SMALL_LIMIT vertices a graph goes onto the levels, edges or not
+    dgraph::DynamicGraph growing(4);
+    growing.add(0, 1);
+    growing.add(2, 3);
+    unsigned last = 3;
+    while (!growing.on_levels()) {
+        last = growing.add_vertex();
+    }
+    REQUIRE(last == dgraph::DynamicGraph::SMALL_LIMIT);
+    REQUIRE(growing.component_size(0) == 2);
+    REQUIRE(!growing.is_connected(1, 2));
+
+    // and long before that once its edges go and leave its rows outweighing
+    // them, while a dense one stays on the bit rows
+    const unsigned limit = dgraph::DynamicGraph::SMALL_LIMIT;
+    dgraph::DynamicGraph star(limit);
+    vector<dgraph::EdgeToken> spokes;
+    for (unsigned v = 1; v < limit; v++) {
+        spokes.push_back(star.add(0, v));
+    }
+    REQUIRE(!star.on_levels());
+    star.remove(std::move(spokes.back()));
+    REQUIRE(star.on_levels());
+    REQUIRE(star.component_size(0) == limit - 1);
+    REQUIRE(star.component_size(limit - 1) == 1);
+    dgraph::DynamicGraph dense(limit / 2);
+    vector<dgraph::EdgeToken> chords;
+    for (unsigned i = 0; i < 10 * limit; i++) {
+        chords.push_back(dense.add(rng() % (limit / 2), rng() % (limit / 2)));
+    }
+    dense.remove(std::move(chords.back()));
+    REQUIRE(!dense.on_levels());
+}
+
+TEST_CASE("batches on a pool give the sequential result", "[dg]") {
+    const unsigned size = 3000;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<unsigned> vertex(0, size - 1);
+    dgraph::ThreadPool pool(3);
+    dgraph::DynamicGraph sequential(size);
+    dgraph::DynamicGraph parallel(size);
+    sequential.use_levels();
+    parallel.use_levels();
+    vector<dgraph::EdgeToken> seq_tokens;
+    vector<dgraph::EdgeToken> par_tokens;
+    for (unsigned round = 0; round < 6; round++) {
+        vector<std::pair<unsigned, unsigned>> batch;
+        for (unsigned k = 0; k < 2500; k++) {
+            batch.push_back(std::make_pair(vertex(rng), vertex(rng)));
+        }
+        auto added = sequential.add_batch(batch);
+        seq_tokens.insert(seq_tokens.end(), added.begin(), added.end());
+        added = parallel.add_batch(batch, pool);
+        par_tokens.insert(par_tokens.end(), added.begin(), added.end());
+
+        vector<dgraph::EdgeToken> seq_removed;
+        vector<dgraph::EdgeToken> par_removed;
+        for (unsigned k = 0; k < 1500; k++) {
+            unsigned j = rng() % seq_tokens.size();
+            seq_removed.push_back(seq_tokens[j]);
+            par_removed.push_back(par_tokens[j]);
+        }
+        sequential.remove_batch(seq_removed);
+        parallel.remove_batch(par_removed, pool);
+
+        INFO("round " << round);
+        for (unsigned v = 0; v < size; v++) {
+            REQUIRE(parallel.component(v) == sequential.component(v));
+            REQUIRE(parallel.component_size(v) == sequential.component_size(v));
+            REQUIRE(parallel.degree(v) == sequential.degree(v));
+        }
+        for (unsigned v = 1; v < size; v++) {
+            REQUIRE(parallel.is_connected(v - 1, v) == sequential.is_connected(v - 1, v));
+        }
+    }
+}
+
+TEST_CASE("local search settles nearby replacements and splits", "[dg]") {
+    dgraph::DynamicGraph graph(5);
+    graph.use_levels();
+    graph.set_sampling(0);
+    auto first = graph.add(0, 1);
+    graph.add(1, 2);
+    graph.add(0, 2);
+    auto bridge = graph.add(2, 3);
+    graph.add(3, 4);
+
+    graph.remove(std::move(first));
+    REQUIRE(graph.is_connected(0, 1));
+    REQUIRE(graph.probe_stats().runs == 1);
+    REQUIRE(graph.probe_stats().replaced == 1);
+
+    graph.remove(std::move(bridge));
+    REQUIRE(!graph.is_connected(2, 3));
+    REQUIRE(graph.component_size(4) == 2);
+    REQUIRE(graph.probe_stats().runs == 2);
+    REQUIRE(graph.probe_stats().split == 1);
+}
+
+TEST_CASE("local search stops at its budget on a star", "[dg]") {
+    // two stars joined at their centres: either side of the bridge has a
+    // whole star of edges at its first vertex
+    const unsigned leaves = 1000;
+    dgraph::DynamicGraph graph(2 * leaves + 2);
+    graph.use_levels();
+    graph.set_sampling(0);
+    graph.set_probe_budget(64);
+    for (unsigned k = 0; k < leaves; k++) {
+        graph.add(0, k + 2);
+        graph.add(1, leaves + k + 2);
+    }
+    auto bridge = graph.add(0, 1);
+
+    graph.remove(std::move(bridge));
+    REQUIRE(graph.probe_stats().runs == 1);
+    REQUIRE(graph.probe_stats().scanned == 64);
+    REQUIRE(graph.probe_stats().split == 0);
+    REQUIRE(!graph.is_connected(0, 1));
+    REQUIRE(graph.component_size(0) == leaves + 1);
+    REQUIRE(graph.component_size(1) == leaves + 1);
+}
+
+TEST_CASE("bulk queries agree with single ones", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 500;
+        std::mt19937 rng(3);
+        dgraph::DynamicGraph graph(size);
+        if (levels) {
+            graph.use_levels();
+        }
+        for (unsigned i = 0; i < 400; i++) {
+            graph.add(rng() % size, rng() % size);
+        }
+        vector<std::pair<unsigned, unsigned>> pairs;
+        for (unsigned i = 0; i < 3001; i++) {
+            pairs.push_back(std::make_pair(rng() % size, rng() % size));
+        }
+        auto connected = graph.is_connected(pairs);
+        REQUIRE(connected.size() == pairs.size());
+        for (unsigned i = 0; i < pairs.size(); i++) {
+            INFO(pairs[i].first << " and " << pairs[i].second);
+            REQUIRE((connected[i] != 0) == graph.is_connected(pairs[i].first, pairs[i].second));
+            REQUIRE((connected[i] != 0) == (graph.component(pairs[i].first) == graph.component(pairs[i].second)));
+        }
+    }
+}
+
+TEST_CASE("queries run alongside a writer", "[dg]") {
+    for (bool levels : {false, true}) {
+        const unsigned size = 300;
+        dgraph::DynamicGraph graph(size);
+        if (levels) {
+            graph.use_levels();
+        }
+        // a path over the first ten vertices stays put while the rest churns
+        for (unsigned v = 1; v < 10; v++) {
+            graph.add(v - 1, v);
+        }
+        std::atomic<bool> done(false);
+        std::atomic<unsigned> failures(0);
+        vector<std::thread> readers;
+        for (unsigned r = 0; r < 3; r++) {
+            readers.emplace_back([&graph, &done, &failures, r]() {
+                std::mt19937 rng(r);
+                while (!done) {
+                    unsigned v = rng() % size;
+                    bool ok = graph.is_connected(0, 9) && graph.is_connected(3, 7) && graph.component_size(5) >= 10
+                              && graph.component_size(v) >= 1 && graph.component_size(v) <= size;
+                    if (!ok) {
+                        failures++;
+                    }
+                }
+            });
+        }
+        std::mt19937 rng(1);
+        vector<dgraph::EdgeToken> tokens;
+        for (unsigned i = 0; i < 20000; i++) {
+            if (tokens.size() > size || (!tokens.empty() && rng() % 3 == 0)) {
+                unsigned j = rng() % tokens.size();
+                graph.remove(std::move(tokens[j]));
+                std::swap(tokens[j], tokens.back());
+                tokens.pop_back();
+            } else {
+                tokens.push_back(graph.add(rng() % size, rng() % size));
+            }
+        }
+        done = true;
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(failures == 0);
+    }
+}
+
 TEST_CASE("dynamic graphs work fine on simple tests", "[dg]"){
     SECTION("simple triangle test") {
         dgraph::DynamicGraph graph(3);
@@ -177,4 +1064,100 @@ TEST_CASE("dynamic graphs work fine on simple tests", "[dg]"){
             check(size, graph, reference);
         }
     }
+
+    SECTION("random operations on a sparse graph") {
+        const unsigned size = 200;
+        std::mt19937 rng(7);
+        dgraph::DynamicGraph graph(size);
+        graph.use_levels();
+        random_updates(size, graph, rng, 20000, 3 * size / 2, 3, 50);
+    }
+
+    SECTION("random batches on a sparse graph") {
+        const unsigned size = 200;
+        const unsigned rounds = 400;
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<unsigned> vertex(0, size - 1);
+
+        ReferenceGraph reference(size);
+        dgraph::DynamicGraph graph(size);
+        graph.use_levels();
+        vector<std::pair<std::pair<unsigned, unsigned>, dgraph::EdgeToken>> edges;
+        for (unsigned i = 0; i < rounds; i++) {
+            unsigned batch_size = 1 + rng() % 40;
+            bool removal = !edges.empty() && (edges.size() > 3 * size / 2 || rng() % 2 == 0);
+            if (removal) {
+                vector<dgraph::EdgeToken> batch;
+                for (unsigned k = 0; k < batch_size && !edges.empty(); k++) {
+                    unsigned j = rng() % edges.size();
+                    reference.remove(edges[j].first.first, edges[j].first.second);
+                    batch.push_back(edges[j].second);
+                    std::swap(edges[j], edges.back());
+                    edges.pop_back();
+                }
+                graph.remove_batch(batch);
+            } else {
+                vector<std::pair<unsigned, unsigned>> batch;
+                for (unsigned k = 0; k < batch_size; k++) {
+                    unsigned v = vertex(rng);
+                    unsigned u = vertex(rng);
+                    if (v == u || reference.is_edge(v, u)) {
+                        continue;
+                    }
+                    reference.add(v, u);
+                    batch.push_back(std::make_pair(v, u));
+                }
+                auto tokens = graph.add_batch(batch);
+                for (unsigned k = 0; k < batch.size(); k++) {
+                    edges.push_back(std::make_pair(batch[k], tokens[k]));
+                }
+            }
+            INFO("round " << i);
+            check_components(size, graph, reference);
+        }
+    }
+
+    SECTION("random operations on a dense graph with and without the heuristics") {
+        const unsigned size = 60;
+        for (unsigned samples : {0u, 4u, 64u}) {
+            INFO("samples " << samples);
+            std::mt19937 rng(samples);
+            dgraph::DynamicGraph graph(size);
+            graph.use_levels();
+            graph.set_sampling(samples);
+            graph.set_probe_budget(samples);
+            random_updates(size, graph, rng, 6000, 10 * size, 4, 20);
+        }
+    }
+
+    SECTION("insert only phases handed over on removal") {
+        const unsigned size = 150;
+        std::mt19937 rng(17);
+        ReferenceGraph reference(size);
+        dgraph::DynamicGraph graph(size);
+        graph.use_levels();
+        vector<std::pair<std::pair<unsigned, unsigned>, dgraph::EdgeToken>> edges;
+        for (unsigned phase = 0; phase < 8; phase++) {
+            graph.insert_only();
+            for (unsigned i = 0; i < 60; i++) {
+                unsigned v = rng() % size;
+                unsigned u = rng() % size;
+                if (v == u || reference.is_edge(v, u)) {
+                    continue;
+                }
+                reference.add(v, u);
+                edges.push_back(std::make_pair(std::make_pair(v, u), graph.add(v, u)));
+            }
+            INFO("phase " << phase);
+            check_components(size, graph, reference);
+            for (unsigned i = 0; i < 40 && !edges.empty(); i++) {
+                unsigned j = rng() % edges.size();
+                reference.remove(edges[j].first.first, edges[j].first.second);
+                graph.remove(std::move(edges[j].second));
+                std::swap(edges[j], edges.back());
+                edges.pop_back();
+                check_components(size, graph, reference);
+            }
+        }
+    }
 }